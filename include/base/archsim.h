@@ -37,6 +37,9 @@
 #include "ansicolors.h"
 #include "err_handler.h"
 #include "machine.h"
+#include "prefetch.h"
+#include "dram.h"
+#include "sweep.h"
 #include "instr_pipeline.h"
 #include "instr.h"
 #include "elf_loader.h"
@@ -53,8 +56,9 @@ extern void handle_args(int, char **);
 /* Provided function to initialize the hw interface. */
 extern void init(void);
 
-/* Provided function to print the final statements of the hw interface. */
-extern void finalize(void);
+/* Provided function to print the final statements of the hw interface and
+ * write the machine's checkpoint. */
+extern void finalize(machine_t *);
 
 /* Variable declarations
  * The following variable declarations allow any file that #includes archsim.h to
@@ -74,10 +78,16 @@ extern FILE *checkpoint;
 /* Used to pass in the name of the input ELF file, through handle_args */
 extern char *infile_name;
 
-/* Count the number of instructions executed by the simulator */
-extern uint64_t num_instr;
+/* The run parameters below are parsed by handle_args and copied into the
+ * machine_t that se simulates. */
 /* Used to arbitrarily limit the number of cycles a program can run */
 extern uint64_t cycle_max;
+/* Number of instructions to run in the functional interpreter before the
+ * pipeline takes over. 0 disables fast-forwarding. */
+extern uint64_t ffwd_max;
+
+/* How se executes the program; see exec_mode_t in machine.h. */
+extern exec_mode_t exec_mode;
 
 /* Used to enable verbose debug logging, as a parameter to show_instr */
 extern int debug_level;
@@ -90,6 +100,30 @@ extern int A;
 extern int B;
 extern int C;
 extern int d;
+/* Whether the cache only models timing and leaves the data in memory (-T). */
+extern bool tag_only;
+/* The cache's replacement policy (-r). */
+extern replacement_t replacement;
+/* The number of MSHRs of a non-blocking cache, or 0 for a blocking one (-m). */
+extern unsigned mshrs;
+/* The number of lines in the data cache's write buffer, or 0 for none (-w). */
+extern unsigned wbuf;
+/* The L1 instruction cache (-I), if have_icache, and the levels below the L1
+ * caches (-L) and how they share lines (-H). */
+extern bool have_icache;
+extern cache_spec_t icache_spec;
+extern cache_spec_t outer_specs[MAX_OUTER];
+extern unsigned num_outer;
+extern inclusion_t inclusion;
+/* The data cache's prefetcher (-p) and how many lines it fetches at a time (-P). */
+extern prefetch_kind_t prefetch;
+extern unsigned prefetch_degree;
+/* The main memory timing model, if have_dram (-D). */
+extern bool have_dram;
+extern dram_spec_t dram_spec;
+/* The cache configurations of a sweep (-s), if num_sweep is not 0. */
+extern cache_spec_t sweep_specs[SWEEP_MAX];
+extern unsigned num_sweep;
 
 /* These are booleans used to control program execution.
  * If ignore_input is true, the current input will no longer be processed. 
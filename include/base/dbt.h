@@ -0,0 +1,38 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * dbt.h - Headers for the dynamic binary translator.
+ *
+ * The translator turns basic blocks of guest instructions into host x86-64
+ * code kept in an executable code cache, and runs them directly against the
+ * architectural state in cur_guest->proc. Each machine gets its own code cache.
+ * Like the interpreter in interp.h it has no notion of cycles; it is the fast
+ * engine behind the "dbt" execution mode.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _DBT_H_
+#define _DBT_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "machine.h"
+
+// Size of the executable code cache in bytes. It is flushed when full.
+#define DBT_CODE_SIZE (16 << 20)
+// Number of entries in the PC -> host code map. Must be a power of 2.
+#define DBT_MAP_SIZE (1 << 16)
+// Maximum number of guest instructions translated into one block.
+#define DBT_MAX_BLOCK 64
+
+// Execute up to max_instr instructions of the current machine starting from its
+// architectural state, stopping early at anything the interpreter would leave to the
+// pipeline. Returns the number of instructions executed. On hosts the
+// translator does not support this is the same as fast_forward.
+extern uint64_t dbt_run(const uint64_t max_instr);
+
+// Release m's translator, if it ever created one.
+extern void dbt_free(machine_t *m);
+#endif
@@ -0,0 +1,61 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * dram.h - Headers for the main memory timing model.
+ *
+ * Without a model, a miss that reaches memory takes the data cache's d
+ * cycles. With one (-D), memory is split into channels, each with its own
+ * data bus, and banks, each with a row buffer. A request's latency then
+ * depends on what its bank is doing: reading an open row costs tCAS, opening
+ * a row in an idle bank tRCD + tCAS, and replacing another open row
+ * tRP + tRCD + tCAS, all after the bank and the channel's bus are free.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _DRAM_H_
+#define _DRAM_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+// Cycles a channel's data bus is busy moving one line.
+#define DRAM_BURST 4
+
+typedef enum row_policy {
+    ROW_OPEN,       // leave a row open after reading it, betting on the next request
+    ROW_CLOSED      // precharge right after every read
+} row_policy_t;
+
+// The parameters of a model, given on the command line as
+// channels:banks:row bytes:tRCD:tCAS:tRP[:open|:closed].
+typedef struct dram_spec {
+    unsigned channels, banks, row_bytes;
+    unsigned tRCD, tCAS, tRP;
+    row_policy_t policy;
+} dram_spec_t;
+
+typedef struct dram_bank {
+    bool open;
+    uint64_t row;           // The row in the row buffer, if open
+    uint64_t ready;         // Cycle from which the bank can take a request
+} dram_bank_t;
+
+typedef struct dram {
+    dram_spec_t spec;
+    dram_bank_t *banks;     // channels * banks of them, channel by channel
+    uint64_t *bus_free;     // Cycle from which each channel's bus is free
+    // Requests by the state of their bank's row buffer.
+    uint64_t row_hits, row_empty, row_conflicts;
+    uint64_t total_latency;
+} dram_t;
+
+// Parse a model's parameters. Returns false (after logging why) if they are invalid.
+extern bool parse_dram(const char *s, dram_spec_t *spec);
+extern dram_t *create_dram(const dram_spec_t *spec);
+extern void free_dram(dram_t *dram);
+// Read the line at addr, asked for in the given cycle. Returns the number of
+// cycles until it arrives, at least 1.
+extern uint64_t dram_access(dram_t *dram, uint64_t addr, uint64_t cycle);
+#endif
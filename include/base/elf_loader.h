@@ -13,6 +13,8 @@
 #ifndef _ELF_LOADER_H_
 #define _ELF_LOADER_H_
 #include <stdint.h>
+#include "machine.h"
 
-extern uint64_t loadElf(const char *file);
+// Load an ELF executable into m's memory and return its entry point.
+extern uint64_t loadElf(machine_t *m, const char *file);
 #endif
\ No newline at end of file
@@ -12,6 +12,7 @@
 
 #ifndef _INTERFACE_H_
 #define _INTERFACE_H_
+#include "machine.h"
 extern void init(void);
-extern void finalize(void);
+extern void finalize(machine_t *);
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * interp.h - Headers for the functional (non-pipelined) interpreter.
+ *
+ * The interpreter executes one instruction at a time directly against the
+ * architectural state in cur_guest->proc and guest memory. It has no notion of
+ * cycles, so it is used to skip over uninteresting parts of a program
+ * before the detailed pipeline model takes over.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _INTERP_H_
+#define _INTERP_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+// Execute the instruction at cur_guest->proc->PC. Returns false, without changing
+// any state, if the instruction has to be left to the pipeline.
+extern bool interp_step(void);
+
+// Execute up to max_instr instructions functionally, starting from the current
+// architectural state. Returns the number of instructions executed.
+extern uint64_t fast_forward(const uint64_t max_instr);
+#endif
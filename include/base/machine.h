@@ -17,16 +17,113 @@
 #include "cache/cache.h"
 
 
-// Machine state.
+/* How a machine executes its program: on the cycle-level pipeline, or
+ * functionally (no timing) with the interpreter or the binary translator. */
+typedef enum exec_mode {
+    EXEC_PIPE,
+    EXEC_FUNC,
+    EXEC_DBT
+} exec_mode_t;
+
+/* How the levels of a cache hierarchy share lines. An inclusive lower level
+ * holds every line of the levels above it, an exclusive one none of them,
+ * and a non-inclusive one whatever it happens to. */
+typedef enum inclusion {
+    NON_INCLUSIVE,
+    INCLUSIVE,
+    EXCLUSIVE
+} inclusion_t;
+
+// Most cache levels below the first (an L2 and an L3).
+#define MAX_OUTER 2
+
+// The parameters of one cache, given on the command line as A:B:C:d.
+typedef struct cache_spec {
+    int A, B, C, d;
+} cache_spec_t;
+
+struct decoded_insn;
+struct dbt;
+struct prefetcher;
+struct dram;
+
+// Machine state. Everything one simulation touches lives here, so any number
+// of machines can be simulated in one process, each on its own host thread.
 typedef struct machine {
     char *name;                 // Descriptive name of machine
     proc_t *proc;               // Pointer to machine's processor
     mem_t *mem;                 // Pointer to machine's memory
-    cache_t *cache;             // Pointer to machine's cache
+    cache_t *cache;             // Pointer to machine's cache (the L1 data cache)
+    cache_t *icache;            // L1 instruction cache, or NULL
+    cache_t *outer[MAX_OUTER];  // Shared levels below the L1 caches, L2 first
+    unsigned num_outer;
+    inclusion_t inclusion;      // How the outer levels share lines with the ones above
     // gpu_t *gpu;
+
+    // Run parameters, filled in from the command line by se.
+    FILE *checkpoint;           // Where log_machine_state writes, or NULL
+    uint64_t cycle_max;         // Limit on cycles (instructions outside the pipeline)
+    uint64_t ffwd_max;          // Instructions to fast-forward before the pipeline starts
+    exec_mode_t exec_mode;      // How runElf executes the program
+    replacement_t policy;       // Replacement policy of the cache, and of the caches swept
+    unsigned num_mshrs;         // Misses the cache can have outstanding, 0 for a blocking cache
+
+    // Simulation state.
+    uint64_t num_instr;         // Cycles (or instructions) executed so far
+    mem_status_t dmem_status;   // Status of the data access in the memory stage
+    uint64_t inflight_cycles;   // Cycles left before the missing line arrives
+    uint64_t inflight_addr;     // Address of the missing line
+    bool inflight;              // Whether a cache miss is being waited on
+    uint64_t dcache_bytes;      // Bytes moved by the data accesses the cache completed
+    mshr_t mshrs[MAX_MSHRS];    // Misses outstanding in a non-blocking cache
+    uint64_t mshr_merges;       // Misses to a line already outstanding
+    uint64_t mshr_full;         // Misses that found every MSHR busy
+    unsigned wbuf_size;         // Lines the write buffer can hold, 0 for none
+    wbuf_entry_t wbuf[MAX_WBUF];
+    uint64_t wbuf_stores;       // Store misses that went into the write buffer
+    uint64_t wbuf_victims;      // Dirty lines written back through it
+    uint64_t wbuf_forwards;     // Misses served from it
+    uint64_t wbuf_full;         // Store misses that stalled because it was full
+    struct prefetcher *prefetcher; // Data cache prefetcher, or NULL
+    struct dram *dram;          // Main memory timing model, or NULL for a fixed latency
+    uint64_t dmem_PC;           // PC of the load or store in the memory stage
+    uint64_t ifetch_line;       // Line fetch last looked up in the instruction cache
+    uint64_t ifetch_ready;      // Cycle in which that line can be fetched from
+    int64_t W_wval;             // Value written back this cycle, read by Decode
+    const cache_spec_t *sweep_specs; // Configurations of the cache sweep (-s)
+    unsigned num_sweep;
+    struct sweep *sweep;        // The running sweep recording data accesses, or NULL
+    struct decoded_insn *predecode; // Predecoded instruction cache
+    struct dbt *dbt;            // Binary translator, created on first use
 } machine_t;
 
+/* The machine the calling thread is simulating. This is a thread-local
+ * pointer: the entry points that take a machine_t set it, and the pipeline
+ * stages, hardware elements and execution engines underneath them reach the
+ * machine through it. A machine is therefore run by one thread at a time
+ * (the stage threads of a PARALLEL build are handed it explicitly), and each
+ * thread of a process can run its own. */
+extern __thread machine_t *cur_guest;
+
 extern uint64_t seg_starts[];   // Starting locations of memory segments (e.g., code, data, stack, etc.).
-extern void init_machine();
-extern void log_machine_state(void);
+// Create a machine with the given cache parameters (-1 for no cache), and make
+// it the calling thread's current machine. A tag-only cache models the same
+// timing but leaves the data in memory (see create_tag_cache).
+extern void init_machine(machine_t *m, int A, int B, int C, int d, bool tag_only, replacement_t policy);
+// Parse a comma-separated list of at most max A:B:C:d cache parameters, or
+// A:B:C ones if with_d is false. Returns the number parsed, or 0 (after
+// logging why) if the list is invalid.
+extern unsigned parse_cache_specs(const char *list, cache_spec_t *specs, unsigned max, bool with_d);
+// Set *inclusion to the policy called name (inclusive, exclusive or
+// non-inclusive). Returns false if there is none.
+extern bool parse_inclusion(const char *name, inclusion_t *inclusion);
+// Add an L1 instruction cache (if icache is not NULL) and num_outer shared
+// levels below the L1 caches to a machine made by init_machine with a cache.
+// Each outer level's d is the latency it adds to a miss that reaches it; the
+// L1 data cache's d is the latency of memory, unless m->dram models it.
+extern void init_hierarchy(machine_t *m, const cache_spec_t *icache, const cache_spec_t *outer,
+                           unsigned num_outer, inclusion_t inclusion);
+// Release everything init_machine and the run allocated.
+extern void free_machine(machine_t *m);
+extern void log_machine_state(machine_t *m);
 #endif
\ No newline at end of file
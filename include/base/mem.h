@@ -12,8 +12,10 @@
 #ifndef _MEM_H_
 #define _MEM_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "ptable.h"
 
 
 // Memory segments corresponding to standard Linux address space.
@@ -34,6 +36,10 @@ typedef struct mem {
     unsigned addr_size;                     // Word size of machine (W)
     uint64_t seg_start_addr[KERNEL_SEG+1];  // Starting addresses of each memory segment
     uint8_t seg_prot[KERNEL_SEG+1];         // Protection bits for each memory segment
+    ptable_t ptable;                        // Pages materialized so far
+    tlb_t itlb, dtlb;                       // Recently used pages of the text segment and the rest
+    void *image;                            // The mapped executable, backing pages loaded from it
+    size_t image_size;
 } mem_t;
 
 // Status of a memory request. Needed for week 4, when cache delay is modeled.
@@ -43,12 +49,39 @@ typedef enum {
     ERROR = -1
 } mem_status_t;
 
-// Return value read from address.
-extern char      mem_read_B (uint64_t address);
-extern short     mem_read_S (uint64_t address);
-extern int       mem_read_I (uint64_t address);
-extern long      mem_read_L (uint64_t address);
-extern long long mem_read_LL(uint64_t address);
+// Most misses a non-blocking data cache can have outstanding (-m).
+#define MAX_MSHRS 32
+
+// A miss status holding register: one line on its way into the data cache.
+typedef struct mshr {
+    bool busy;
+    uint64_t line;          // Address of the missing line
+    uint64_t ready;         // Cycle in which the line arrives
+    bool write;             // Whether stores have been merged into it
+    uint8_t *pending;       // The stores' bytes, then one flag per byte of the line
+} mshr_t;
+
+// Most lines a write buffer can hold (-w).
+#define MAX_WBUF 32
+
+// One line in the write buffer: a dirty line on its way to memory, or the
+// stores that missed on a line still on its way into the data cache.
+typedef struct wbuf_entry {
+    bool busy;
+    bool victim;            // Whether it is a dirty line rather than stores
+    uint64_t line;          // Address of the line
+    uint64_t ready;         // Cycle in which it is written to memory or the cache
+    uint8_t *bytes;         // The line's bytes, then one flag per byte holding a store
+} wbuf_entry_t;
+
+struct machine;
+
+// Return value read from address in machine m's memory.
+extern char      mem_read_B (struct machine *m, uint64_t address);
+extern short     mem_read_S (struct machine *m, uint64_t address);
+extern int       mem_read_I (struct machine *m, uint64_t address);
+extern long      mem_read_L (struct machine *m, uint64_t address);
+extern long long mem_read_LL(struct machine *m, uint64_t address);
 
 // Return codes for memory writes.
 typedef enum write_ret_code {
@@ -56,12 +89,16 @@ typedef enum write_ret_code {
     WRITE_SUCCESS
 } write_ret_code_t, mrc_t;
 
-// Write data to address.
-extern write_ret_code_t mem_write_B (uint64_t address, char      data);
-extern write_ret_code_t mem_write_S (uint64_t address, short     data);
-extern write_ret_code_t mem_write_I (uint64_t address, int       data);
-extern write_ret_code_t mem_write_L (uint64_t address, long      data);
-extern write_ret_code_t mem_write_LL(uint64_t address, long long data);
+// Write data to address in machine m's memory.
+extern write_ret_code_t mem_write_B (struct machine *m, uint64_t address, char      data);
+extern write_ret_code_t mem_write_S (struct machine *m, uint64_t address, short     data);
+extern write_ret_code_t mem_write_I (struct machine *m, uint64_t address, int       data);
+extern write_ret_code_t mem_write_L (struct machine *m, uint64_t address, long      data);
+extern write_ret_code_t mem_write_LL(struct machine *m, uint64_t address, long long data);
+
+// Look up the instruction at address in machine m's L1 instruction cache, if
+// it has one. Returns false while the line is still on its way.
+extern bool mem_ifetch(struct machine *m, uint64_t address);
 
 // Helper functions.
 extern bool addr_in_imem(const uint64_t);
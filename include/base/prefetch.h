@@ -0,0 +1,74 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * prefetch.h - Headers for the data cache's hardware prefetchers.
+ *
+ * A prefetcher watches the lines the memory stage looks up in the data cache
+ * and names lines it expects to be needed next. mem.c fetches those into the
+ * cache in the background, taking as long as a miss would, and counts how
+ * the prefetched lines turn out.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _PREFETCH_H_
+#define _PREFETCH_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum prefetch_kind {
+    PREFETCH_NONE,
+    PREFETCH_NEXT_LINE,     /* the lines after one that missed */
+    PREFETCH_STRIDE,        /* a constant stride between one instruction's accesses */
+    PREFETCH_STREAM,        /* a run of misses to neighbouring lines, in either direction */
+    NUM_PREFETCH
+} prefetch_kind_t;
+
+// Most prefetches on their way into the cache at once.
+#define PREFETCH_QUEUE 16
+// Most lines one access can have prefetched (-P).
+#define MAX_PREFETCH_DEGREE 8
+
+typedef struct prefetch_entry {
+    uint64_t line;          // Address of the line
+    uint64_t ready;         // Cycle in which it arrives
+} prefetch_entry_t;
+
+typedef struct prefetcher {
+    prefetch_kind_t kind;
+    const struct prefetch_ops *ops;
+    unsigned degree;        // Lines prefetched per triggering access
+    unsigned b;             // log2 of the data cache's line size
+    void *table;            // The detector's own state
+    prefetch_entry_t queue[PREFETCH_QUEUE];
+    unsigned queued;
+    // How the prefetches turned out.
+    uint64_t issued;        // Sent to memory
+    uint64_t useful;        // Hit by a demand access after arriving
+    uint64_t late;          // Missed by a demand access while still on the way
+    uint64_t polluting;     // Evicted before any demand access used them
+    uint64_t dropped;       // Not sent because the queue was full
+} prefetcher_t;
+
+/*
+ * Each detector is told about every line a demand access looks up: the PC of
+ * the load or store, the address it accessed, and whether the lookup missed
+ * or was the first to use a prefetched line. It writes up to degree
+ * addresses to prefetch into lines and returns how many it wrote.
+ */
+typedef struct prefetch_ops {
+    const char *name;
+    size_t table_size;
+    unsigned (*train)(prefetcher_t *pf, uint64_t pc, uint64_t addr, bool trigger, uint64_t *lines);
+} prefetch_ops_t;
+
+// Set *kind to the prefetcher called name. Returns false if there is none.
+extern bool parse_prefetcher(const char *name, prefetch_kind_t *kind);
+extern const char *prefetcher_name(prefetch_kind_t kind);
+// A prefetcher of the given kind for a data cache with B-byte lines.
+extern prefetcher_t *create_prefetcher(prefetch_kind_t kind, unsigned degree, unsigned B);
+extern void free_prefetcher(prefetcher_t *pf);
+#endif
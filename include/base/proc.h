@@ -37,6 +37,8 @@ typedef struct proc {
     stat_t status;      // Pipeline status
 } proc_t;
 
-// Run the loaded ELF executable for no more than a specified number of cycles.
-extern int runElf(const uint64_t);
+struct machine;
+
+// Run the ELF executable loaded into a machine for no more than its cycle limit.
+extern int runElf(struct machine *, const uint64_t);
 #endif
\ No newline at end of file
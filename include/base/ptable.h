@@ -14,6 +14,7 @@
 #ifndef _PTABLE_H_
 #define _PTABLE_H_
 #include <stdint.h>
+#include <stdbool.h>
 
 /* This corresponds to the Arm64 notion of a hardware page (see ADRP) */
 #define PAGESIZE 4096
@@ -23,11 +24,40 @@ typedef struct pte {
     uint64_t p_num;     // The page number.
     unsigned p_prot;    // The page protection bits.
     char *p_data;       // The page payload.
-    struct pte *p_next; // Link to next PTE.
+    bool p_shared;      // The payload is not the page's own: copy it before writing.
 } pte_t, *pte_ptr_t;
 
+// Number of slots a page table starts with. It doubles whenever it is half full.
+#define PTABLE_INITSIZE 64
+
+// A page table, one per guest memory: an open-addressing hash table on the page number.
+typedef struct ptable {
+    pte_ptr_t *slots;   // NULL for an empty slot
+    uint64_t size;      // Number of slots, a power of 2 (0 until the first page is added)
+    uint64_t count;     // Number of pages
+} ptable_t;
+
+// Number of entries in a software TLB.
+#define TLB_SIZE 64
+
+// A direct-mapped cache of recently used PTEs, indexed by the low bits of the page number.
+typedef struct tlb {
+    uint64_t pnum[TLB_SIZE];
+    pte_ptr_t page[TLB_SIZE];   // NULL for an empty entry
+    uint64_t hits, misses;
+} tlb_t;
+
 // Get a pointer to a PTE given its page number.
-extern pte_ptr_t get_page(const uint64_t);
+extern pte_ptr_t get_page(ptable_t *, const uint64_t);
 // Materialize a page with the given page number and protection bits.
-extern pte_ptr_t add_page(const uint64_t, const uint8_t);
+extern pte_ptr_t add_page(ptable_t *, const uint64_t, const uint8_t);
+// Materialize a page whose payload is PAGESIZE bytes owned by someone else,
+// such as zero_page or the mapped executable. unshare_page gives the page a
+// copy of its own, which must happen before any write to it.
+extern pte_ptr_t add_shared_page(ptable_t *, const uint64_t, const uint8_t, const char *);
+extern void unshare_page(pte_ptr_t);
+// Payload of every page that has been read but never written.
+extern const char zero_page[PAGESIZE];
+// Free every page in the table.
+extern void free_ptable(ptable_t *);
 #endif
\ No newline at end of file
@@ -0,0 +1,41 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * sweep.h - Headers for simulating many cache configurations in one run.
+ *
+ * A miss in the data cache freezes F, D, X and M for d-1 cycles and changes
+ * nothing else about the pipeline's timing. So the pipeline is run once with
+ * no cache, the data accesses it makes are recorded, and every configuration
+ * replays them on its own cache_t in a worker thread, adding up its own stall
+ * cycles. Each configuration ends with the cycle count and cache statistics
+ * a separate run with -A -B -C -d would have reported.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "cache.h"
+#include "machine.h"
+
+// Maximum number of configurations in one sweep.
+#define SWEEP_MAX 64
+// Number of accesses handed to the workers at a time.
+#define SWEEP_CHUNK 65536
+
+// Create a cache and worker thread for each of m's sweep_specs and start
+// recording m's data accesses in m->sweep. Does nothing if m has none. Every
+// machine keeps its own sweep, but only se takes -s; se-batch jobs are not swept.
+extern void sweep_start(machine_t *m);
+
+// Record a data access m made in its current cycle.
+extern void sweep_access(const machine_t *m, uint64_t addr, unsigned width, operation_t op);
+
+// Stop recording, wait for the workers, and print one CSV row per
+// configuration, given the number of cycles m ran for.
+extern void sweep_finish(machine_t *m);
+#endif
@@ -13,35 +13,90 @@
 #define _CACHE_H_
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /*
  * A possible hierarchy for the cache. The helper functions defined below
  * are based on this cache structure.
- * lru is a counter used to implement LRU replacement policy.
  */
 
 typedef unsigned char byte_t;
 typedef long long int word_t;
 typedef long long unsigned uword_t;
 
+/*
+ * The tags are kept apart from the rest of each line, packed per set, so
+ * that a lookup can compare several ways at once. A way holding no line
+ * has the tag TAG_INVALID, which no address produces, so it never matches.
+ */
+#define TAG_INVALID (~0ULL)
+
 typedef struct cache_line {
-    bool valid;
-    uword_t tag;
     bool dirty;
-    uword_t lru;
-    byte_t *data;
+    bool prefetched;    /* filled by a prefetch and not used since */
 } cache_line_t;
 
-typedef struct cache_set {
-    cache_line_t *lines;
-} cache_set_t;
+/*
+ * Replacement policies. Each keeps a few words of state per set, updated in
+ * constant time (logarithmic in A for PLRU) when a line is hit or filled.
+ * While a set has invalid ways, every policy fills the first of them.
+ */
+typedef enum {
+    REPL_LRU,       /* true LRU, a recency stack per set */
+    REPL_PLRU,      /* tree pseudo-LRU */
+    REPL_NRU,       /* not recently used, one bit per way */
+    REPL_SRRIP,     /* static re-reference interval prediction, 2-bit RRPVs */
+    REPL_BRRIP,     /* bimodal RRIP, inserting mostly at distant re-reference */
+    REPL_RANDOM,
+    NUM_REPL
+} replacement_t;
+
+struct cache;
+typedef struct repl_ops {
+    const char *name;
+    size_t (*set_words)(unsigned int A);    /* words of state per set */
+    void (*init)(struct cache *cache, uint64_t *set);
+    void (*touch)(struct cache *cache, uint64_t *set, unsigned int way);   /* on a hit */
+    void (*insert)(struct cache *cache, uint64_t *set, unsigned int way);  /* on a fill */
+    unsigned int (*victim)(struct cache *cache, uint64_t *set);            /* in a full set */
+} repl_ops_t;
 
+/*
+ * Way j of set i is entry i * A + j of tags and lines, and its data is the
+ * B bytes at offset (i * A + j) * B of data. Set i's replacement state is the
+ * repl_words words at repl_state + i * repl_words: the number of valid ways,
+ * then whatever the policy keeps. The tags, lines and replacement
+ * state share one allocation and the data has another, both aligned to host
+ * cache lines. A tag-only cache, which models timing alone, has no data at all.
+ */
 typedef struct cache {
-    cache_set_t *sets;
+    uword_t *tags;
+    cache_line_t *lines;
+    byte_t *data;           /* NULL for a tag-only cache */
     unsigned int A; /* Associativity */
     unsigned int B; /* Bytes per block or line */
     unsigned int C; /* Capacity */
     unsigned int d; /* delay - used as a cache miss penalty */
+
+    /* Statistics, kept per cache so several can be simulated at once. */
+    int hit_count;
+    int miss_count;
+    int dirty_eviction_count;
+    int clean_eviction_count;
+
+    /* Replacement policy and its state. */
+    replacement_t policy;
+    const repl_ops_t *repl;
+    uint64_t *repl_state;
+    size_t repl_words;
+    uint64_t rand_state;        /* for the random and bimodal policies */
+
+    /* Derived from the geometry by create_cache. */
+    unsigned int b;             /* log2(B), the number of block offset bits */
+    unsigned int s;             /* log2(S), the number of set index bits */
+    uword_t set_mask;           /* S - 1 */
+    /* Returns the way of a set's tags holding the given tag, or -1. */
+    int (*find_way)(const uword_t *tags, uword_t tag, unsigned int A);
 } cache_t;
 
 
@@ -53,16 +108,26 @@ typedef enum {
 typedef struct {
     bool valid;
     bool dirty;
+    bool prefetched;
     uword_t addr;
     byte_t *data;
 } evicted_line_t;
 
 
 cache_t *create_cache(int A_in, int B_in, int C_in, int d_in);
+cache_t *create_tag_cache(int A_in, int B_in, int C_in, int d_in);
+cache_t *create_cache_policy(int A_in, int B_in, int C_in, int d_in, replacement_t policy, bool with_data);
+bool parse_replacement(const char *name, replacement_t *policy);
+const char *replacement_name(replacement_t policy);
 void free_cache(cache_t *cache);
 void access_data(cache_t *cache, uword_t addr, operation_t operation);
 
-evicted_line_t *handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data);
+byte_t *line_data(cache_t *cache, cache_line_t *line);
+cache_line_t *get_line(cache_t *cache, uword_t addr);
+cache_line_t *replace_line(cache_t *cache, uword_t addr, operation_t operation, evicted_line_t *evicted);
+bool invalidate_line(cache_t *cache, uword_t addr, evicted_line_t *evicted);
+cache_line_t *handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data,
+                          evicted_line_t *evicted, byte_t *old_data);
 bool check_hit(cache_t *cache, uword_t addr, operation_t operation);
 
 void get_word_cache(cache_t *cache, uword_t addr, word_t *dest);
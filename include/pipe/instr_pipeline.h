@@ -92,6 +92,7 @@ typedef struct d_instr_impl {
     opcode_t op;            // instruction opcode
     opcode_t print_op;      // opcode to print: needed for aliased instructions
     // uint64_t this_PC;       // PC of this instruction: needed for ADRP
+    uint64_t this_PC;       // PC of this instruction: used to find its predecoded entry
     union {
         uint64_t seq_succ_PC;   // next sequential PC
         uint64_t adrp_val;      // used for adrp
@@ -103,6 +104,7 @@ typedef struct d_instr_impl {
 typedef struct x_instr_impl {
     opcode_t op;            // instruction opcode
     opcode_t print_op;      // opcode to print: needed for aliased instructions
+    uint64_t this_PC;       // PC of this instruction: used to train the prefetcher
     uint64_t seq_succ_PC;   // next sequential PC
     x_ctl_sigs_t X_sigs;    // signals consumed by execute stage
     m_ctl_sigs_t M_sigs;    // signals consumed by memory stage
@@ -121,6 +123,7 @@ typedef struct x_instr_impl {
 typedef struct m_instr_impl {
     opcode_t op;            // instruction opcode (only for debugging at this point)
     opcode_t print_op;      // opcode to print: needed for aliased instructions
+    uint64_t this_PC;       // PC of this instruction: used to train the prefetcher
     uint64_t seq_succ_PC;   // next sequential PC
     bool cond_holds;        // result of testing NZCV codes
     m_ctl_sigs_t M_sigs;    // signals consumed by memory stage
@@ -178,25 +181,25 @@ typedef struct pipeline_register {
  * You should really use these macros.
  * They will save a lot of time and space.
  */
-#define F_instr (guest.proc->f_insn)
-#define F_in  (guest.proc->f_insn->in.f)
-#define F_out   (guest.proc->f_insn->out.f)
+#define F_instr (cur_guest->proc->f_insn)
+#define F_in  (cur_guest->proc->f_insn->in.f)
+#define F_out   (cur_guest->proc->f_insn->out.f)
 
-#define D_instr (guest.proc->d_insn)
-#define D_in   (guest.proc->d_insn->in.d)
-#define D_out   (guest.proc->d_insn->out.d)
+#define D_instr (cur_guest->proc->d_insn)
+#define D_in   (cur_guest->proc->d_insn->in.d)
+#define D_out   (cur_guest->proc->d_insn->out.d)
 
-#define X_instr (guest.proc->x_insn)
-#define X_in    (guest.proc->x_insn->in.x)
-#define X_out   (guest.proc->x_insn->out.x)
+#define X_instr (cur_guest->proc->x_insn)
+#define X_in    (cur_guest->proc->x_insn->in.x)
+#define X_out   (cur_guest->proc->x_insn->out.x)
 
-#define M_instr (guest.proc->m_insn)
-#define M_in    (guest.proc->m_insn->in.m)
-#define M_out   (guest.proc->m_insn->out.m)
+#define M_instr (cur_guest->proc->m_insn)
+#define M_in    (cur_guest->proc->m_insn->in.m)
+#define M_out   (cur_guest->proc->m_insn->out.m)
 
-#define W_instr (guest.proc->w_insn)
-#define W_in   (guest.proc->w_insn->in.w)
-#define W_out  (guest.proc->w_insn->out.w)
+#define W_instr (cur_guest->proc->w_insn)
+#define W_in   (cur_guest->proc->w_insn->in.w)
+#define W_out  (cur_guest->proc->w_insn->out.w)
 
 /* Function prototypes. */
 extern uint32_t bitfield_u32(int32_t src, unsigned frompos, unsigned width);
@@ -208,4 +211,12 @@ extern comb_logic_t execute_instr(x_instr_impl_t *in, m_instr_impl_t *out);
 extern comb_logic_t memory_instr(m_instr_impl_t *in, w_instr_impl_t *out);
 extern comb_logic_t wback_instr(w_instr_impl_t *in);
 extern void show_instr(const proc_stage_t, int);
+/* Helpers of Fetch and Decode that predecode.c also uses to fill its entries. */
+extern void fix_instr_aliases(uint32_t insnbits, opcode_t *op);
+extern comb_logic_t generate_DXMW_control(opcode_t op, x_ctl_sigs_t *X_sigs,
+                                          m_ctl_sigs_t *M_sigs, w_ctl_sigs_t *W_sigs);
+extern comb_logic_t extract_regs(uint32_t insnbits, opcode_t op, uint8_t *src1,
+                                 uint8_t *src2, uint8_t *dst);
+extern comb_logic_t extract_immval(uint32_t insnbits, opcode_t op, int64_t *imm);
+extern comb_logic_t decide_alu_op(opcode_t op, alu_op_t *ALU_op);
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * predecode.h - Headers for the predecoded instruction cache.
+ *
+ * Fetch fills one entry per PC the first time it is fetched; Decode and the
+ * functional interpreter then reuse the extracted fields and control signals
+ * instead of re-deriving them from the instruction bits. Entries are dropped
+ * whenever a store writes to the text segment.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#ifndef _PREDECODE_H_
+#define _PREDECODE_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "instr.h"
+#include "instr_pipeline.h"
+
+// Number of entries in the (direct-mapped) predecode cache. Must be a power of 2.
+// Each machine has its own, with one extra entry to hold bad fetches.
+#define PREDECODE_SIZE 4096
+
+// Everything Fetch and Decode derive from the bits of one instruction.
+typedef struct decoded_insn {
+    uint64_t PC;            // address the entry was filled from
+    bool valid;             // whether the entry holds a decoded instruction
+    uint32_t insnbits;      // instruction bits
+    opcode_t op;            // opcode, with aliases resolved
+    uint8_t src1;           // first source register
+    uint8_t src2;           // second source register (offset for LDUR/STUR)
+    uint8_t dst;            // destination register
+    int64_t imm;            // immediate operand, if the instruction has one
+    alu_op_t ALU_op;        // operation for the ALU to perform
+    x_ctl_sigs_t X_sigs;    // signals consumed by execute stage
+    m_ctl_sigs_t M_sigs;    // signals consumed by memory stage
+    w_ctl_sigs_t W_sigs;    // signals consumed by writeback stage
+} decoded_insn_t;
+
+// Decode insnbits (already mapped to op) into *di without touching the cache.
+extern void decode_fields(uint32_t insnbits, opcode_t op, decoded_insn_t *di);
+
+// Fetch and decode the instruction at PC, going through the current machine's
+// cache. *imem_err is set as by imem; the entry returned for a bad address is
+// not cached.
+extern const decoded_insn_t *predecode(uint64_t PC, bool *imem_err);
+
+// Return the cached entry for PC if it still decodes insnbits as op, else NULL.
+extern const decoded_insn_t *predecode_lookup(uint64_t PC, uint32_t insnbits, opcode_t op);
+
+struct machine;
+
+// Drop every entry of m's cache overlapping the width bytes written at addr.
+extern void predecode_invalidate(struct machine *m, uint64_t addr, unsigned width);
+#endif
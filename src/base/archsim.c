@@ -13,30 +13,59 @@
 
 #include "archsim.h"
 
-machine_t       guest;
 opcode_t        itable[2<<11];
 FILE            *infile, *outfile, *errfile, *checkpoint;
 char            *infile_name;
 char            *hw_prompt;
-uint64_t        num_instr;
 uint64_t        cycle_max;
+uint64_t        ffwd_max;
+exec_mode_t     exec_mode;
 int             debug_level;
 int             A, B, C, d;
-uint64_t        inflight_cycles;
-uint64_t        inflight_addr;
-bool            inflight;
-mem_status_t    dmem_status;
+bool            tag_only;
+replacement_t   replacement;
+unsigned        mshrs;
+cache_spec_t    sweep_specs[SWEEP_MAX];
+unsigned        num_sweep;
+unsigned        wbuf;
+bool            have_icache;
+cache_spec_t    icache_spec;
+cache_spec_t    outer_specs[MAX_OUTER];
+unsigned        num_outer;
+inclusion_t     inclusion;
+prefetch_kind_t prefetch;
+unsigned        prefetch_degree;
+bool            have_dram;
+dram_spec_t     dram_spec;
+
+static machine_t machine;
 
 int main(int argc, char* argv[]) {
     debug_level = 0;
     cycle_max = MAX_NUM_INSTR;
     handle_args(argc, argv);
     init();
+
+    init_machine(&machine, A, B, C, d, tag_only, replacement);
+    if (machine.cache)
+        init_hierarchy(&machine, have_icache ? &icache_spec : NULL, outer_specs, num_outer, inclusion);
+    machine.checkpoint = checkpoint;
+    machine.cycle_max = cycle_max;
+    machine.ffwd_max = ffwd_max;
+    machine.exec_mode = exec_mode;
+    machine.num_mshrs = mshrs;
+    machine.sweep_specs = sweep_specs;
+    machine.num_sweep = num_sweep;
+    machine.wbuf_size = wbuf;
+    if (have_dram)
+        machine.dram = create_dram(&dram_spec);
+    if (machine.cache && prefetch != PREFETCH_NONE)
+        machine.prefetcher = create_prefetcher(prefetch, prefetch_degree, machine.cache->B);
     
-    uint64_t entry = loadElf(infile_name);
-    int ret = runElf(entry);
+    uint64_t entry = loadElf(&machine, infile_name);
+    int ret = runElf(&machine, entry);
     
-    finalize();
+    finalize(&machine);
     
     return ret;
 }
@@ -0,0 +1,601 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * dbt.c - Dynamic binary translator for the functional execution modes.
+ *
+ * A block is translated the first time its PC is reached. Each guest
+ * instruction is taken from the predecode cache and turned into x86-64 code
+ * that reads and writes the registers and flags in cur_guest->proc directly;
+ * loads and stores call back into the runtime, which uses dmem just like
+ * the interpreter does, so IO_CHAR_ADDR and CHECKPOINT_ADDR still trap.
+ * Direct branches are chained: the first time a block exits to another one,
+ * the dispatcher patches the exit jump to go straight to the target.
+ *
+ * Anything the translator does not handle (halts, faults, returning from
+ * main, unsupported opcodes) ends the block and is handed to interp_step, so
+ * the architectural state always matches the interpreter instruction for
+ * instruction.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stddef.h>
+#include "archsim.h"
+#include "hw_elts.h"
+#include "interp.h"
+#include "dbt.h"
+
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include "predecode.h"
+
+#define SP_NUM 31
+#define XZR_NUM 32
+
+// Upper bound on the host code generated for one guest instruction.
+#define DBT_INSN_BYTES 128
+
+// Host registers used as temporaries by the generated code.
+enum { RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7 };
+
+// Condition codes for jcc.
+enum { CC_E = 0x4, CC_NE = 0x5, CC_AE = 0x3, CC_A = 0x7 };
+
+// Results of translating one instruction.
+enum { INSN_NONE, INSN_NEXT, INSN_END };
+
+// Values a block returns to the dispatcher, besides the address of a patch site.
+#define EXIT_LOOKUP 0   // continue at cur_guest->proc->PC
+#define EXIT_INTERP 1   // run the instruction at cur_guest->proc->PC in the interpreter
+
+// Counters kept in r12 (icount) and r14 (limit) while in generated code.
+typedef struct dbt_state {
+    uint64_t icount;    // instructions retired so far
+    uint64_t limit;     // a block never starts if it could retire past this
+} dbt_state_t;
+
+typedef uintptr_t (*dbt_enter_t)(proc_t *proc, uint8_t *code, dbt_state_t *state);
+
+typedef struct dbt_map_entry {
+    uint64_t PC;
+    uint8_t *code;
+} dbt_map_entry_t;
+
+// Returned in rax:rdx by dbt_load.
+typedef struct dbt_load_ret {
+    uint64_t val;
+    uint64_t ok;
+} dbt_load_ret_t;
+
+// One translator per machine, so its code cache only ever holds that machine's code.
+struct dbt {
+    uint8_t *code_base;         // start of the code cache
+    uint8_t *code_start;        // first byte after the entry and exit trampolines
+    uint8_t *code_ptr;          // where the next block goes
+    dbt_enter_t dbt_enter;
+    uint8_t *dbt_epilogue;
+
+    dbt_map_entry_t map[DBT_MAP_SIZE];
+    unsigned map_used;
+    uint64_t epoch;             // bumped on every flush, so stale patch sites are never written
+    dbt_state_t state;
+};
+
+// The translator of the machine this thread is running.
+static __thread struct dbt *t;
+
+/* Code emission */
+
+#define EMIT(...) do { \
+    static const uint8_t bytes_[] = {__VA_ARGS__}; \
+    emit_bytes(bytes_, sizeof(bytes_)); \
+} while (0)
+
+static void emit_bytes(const uint8_t *bytes, size_t n) {
+    memcpy(t->code_ptr, bytes, n);
+    t->code_ptr += n;
+}
+
+static void emit8(uint8_t val) { *t->code_ptr++ = val; }
+static void emit32(uint32_t val) { memcpy(t->code_ptr, &val, 4); t->code_ptr += 4; }
+static void emit64(uint64_t val) { memcpy(t->code_ptr, &val, 8); t->code_ptr += 8; }
+
+// Emit a rel32 field to be filled in by patch_rel32.
+static uint8_t *emit_rel32(void) {
+    uint8_t *site = t->code_ptr;
+    emit32(0);
+    return site;
+}
+
+static void patch_rel32(uint8_t *site, const uint8_t *target) {
+    int32_t rel = (int32_t) (target - (site + 4));
+    memcpy(site, &rel, 4);
+}
+
+static uint8_t *emit_jcc(uint8_t cc) {
+    EMIT(0x0F);
+    emit8(0x80 | cc);
+    return emit_rel32();
+}
+
+static void emit_jmp(const uint8_t *target) {
+    emit8(0xE9);
+    patch_rel32(emit_rel32(), target);
+}
+
+// mov r, imm
+static void emit_mov_imm(int r, uint64_t imm) {
+    if (imm <= UINT32_MAX) {
+        emit8(0xB8 + r);
+        emit32(imm);
+    } else {
+        EMIT(0x48);
+        emit8(0xB8 + r);
+        emit64(imm);
+    }
+}
+
+// mov r, [rbx + off]
+static void emit_load_proc(int r, int32_t off) {
+    EMIT(0x48, 0x8B);
+    emit8(0x83 | (r << 3));
+    emit32(off);
+}
+
+// mov [rbx + off], r
+static void emit_store_proc(int r, int32_t off) {
+    EMIT(0x48, 0x89);
+    emit8(0x83 | (r << 3));
+    emit32(off);
+}
+
+static int32_t reg_offset(uint8_t reg) {
+    return reg < SP_NUM ? offsetof(proc_t, GPR) + 8 * reg : offsetof(proc_t, SP);
+}
+
+// Read a register the way regfile does: 31 is SP and 32 reads as zero.
+static void emit_read_reg(int r, uint8_t reg) {
+    if (reg <= SP_NUM) {
+        emit_load_proc(r, reg_offset(reg));
+    } else {
+        emit8(0x31);    // xor r32, r32
+        emit8(0xC0 | (r << 3) | r);
+    }
+}
+
+static void emit_write_reg(int r, uint8_t reg) {
+    if (reg <= SP_NUM)
+        emit_store_proc(r, reg_offset(reg));
+}
+
+static void emit_call(const void *fn) {
+    emit_mov_imm(RAX, (uintptr_t) fn);
+    EMIT(0xFF, 0xD0);                   // call rax
+}
+
+static void emit_retire(unsigned ninsn) {
+    if (ninsn) {
+        EMIT(0x49, 0x81, 0xC4);         // add r12, imm32
+        emit32(ninsn);
+    }
+}
+
+// Leave generated code with cur_guest->proc->PC = PC after retiring ninsn instructions.
+static void emit_exit(uint64_t PC, unsigned ninsn, uintptr_t ret) {
+    emit_retire(ninsn);
+    emit_mov_imm(RAX, PC);
+    emit_store_proc(RAX, offsetof(proc_t, PC));
+    emit_mov_imm(RAX, ret);
+    emit_jmp(t->dbt_epilogue);
+}
+
+// Like emit_exit, but through a jump the dispatcher can later point straight at
+// the block for PC.
+static void emit_exit_chained(uint64_t PC, unsigned ninsn) {
+    emit_retire(ninsn);
+    emit8(0xE9);
+    uint8_t *site = emit_rel32();
+    patch_rel32(site, t->code_ptr);
+    emit_mov_imm(RAX, PC);
+    emit_store_proc(RAX, offsetof(proc_t, PC));
+    EMIT(0x48, 0xB8);                   // mov rax, imm64
+    emit64((uintptr_t) site);
+    emit_jmp(t->dbt_epilogue);
+}
+
+/* Runtime helpers called from generated code */
+
+// Same checks as the interpreter; ok is 0 if the access has to be left to the pipeline.
+static bool dbt_mem_ok(uint64_t addr) {
+    return is_special_addr(addr) || (addr_in_dmem(addr) && !(addr & 0x7U));
+}
+
+static dbt_load_ret_t dbt_load(uint64_t addr, uint64_t PC) {
+    dbt_load_ret_t ret = {0, 0};
+    bool dmem_err = false;
+    if (!dbt_mem_ok(addr))
+        return ret;
+    // A checkpoint trap logs the PC of the access, as in the interpreter.
+    cur_guest->proc->PC = PC;
+    dmem(addr, 0, true, false, &ret.val, &dmem_err);
+    ret.ok = 1;
+    return ret;
+}
+
+static uint64_t dbt_store(uint64_t addr, uint64_t val, uint64_t PC) {
+    uint64_t rval = 0;
+    bool dmem_err = false;
+    if (!dbt_mem_ok(addr))
+        return 0;
+    cur_guest->proc->PC = PC;
+    dmem(addr, val, false, true, &rval, &dmem_err);
+    return 1;
+}
+
+/* Translation */
+
+// Bit n of the result is set if cond holds when the flags are n.
+static uint32_t cond_mask(cond_t cond) {
+    uint32_t mask = 0;
+    for (uint8_t nzcv = 0; nzcv < 16; nzcv++) {
+        uint64_t val_e = 0;
+        bool cond_val = true;
+        uint8_t flags = nzcv;
+        alu(0, 0, 0, PASS_A_OP, false, cond, &val_e, &cond_val, &flags);
+        if (cond_val)
+            mask |= 1U << nzcv;
+    }
+    return mask;
+}
+
+// Compute NZCV the way alu does from the host flags left by the last operation.
+static void emit_flags(alu_op_t ALU_op) {
+    if (ALU_op != PLUS_OP && ALU_op != MINUS_OP)
+        EMIT(0x48, 0x85, 0xC0);                     // test rax, rax
+    EMIT(0x9C, 0x5A,                                // pushfq; pop rdx
+         0x89, 0xD7, 0xC1, 0xEF, 0x04,              // edi = SF,ZF >> 4
+         0x83, 0xE7, 0x0C,                          //   & 0xC
+         0x89, 0xD0, 0x83, 0xE0, 0x01);             // eax = CF
+    if (ALU_op == MINUS_OP)
+        EMIT(0x83, 0xF0, 0x01);                     // C is "no borrow"
+    EMIT(0x01, 0xC0, 0x09, 0xC7,                    // edi |= eax << 1
+         0xC1, 0xEA, 0x0B, 0x83, 0xE2, 0x01,        // edx = OF
+         0x09, 0xD7);                               // edi |= edx
+    if (ALU_op == MINUS_OP) {
+        // alu also reports overflow whenever valb is INT64_MIN.
+        EMIT(0x48, 0xB8);
+        emit64(0x8000000000000000ULL);
+        EMIT(0x48, 0x39, 0xC1,                      // cmp rcx, rax
+             0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0,    // eax = ZF
+             0x09, 0xC7);                           // edi |= eax
+    }
+    EMIT(0x40, 0x88, 0xBB);                         // mov [rbx + NZCV], dil
+    emit32(offsetof(proc_t, NZCV));
+}
+
+static void emit_alu(const decoded_insn_t *di, uint64_t PC) {
+    opcode_t op = di->op;
+    uint8_t val_hw = 0;
+
+    // val_a in rax, set up exactly as interp_step does
+    if (op == OP_MOVZ || op == OP_MOVK) {
+        val_hw = bitfield_u32(di->insnbits, 21, 2) * 16;
+        if (op == OP_MOVK && di->dst < SP_NUM) {
+            emit_read_reg(RAX, di->dst);
+            emit_mov_imm(RDX, ~(0xFFFFULL << val_hw));
+            EMIT(0x48, 0x21, 0xD0);                 // and rax, rdx
+        } else {
+            emit_read_reg(RAX, XZR_NUM);
+        }
+    } else if (op == OP_MVN) {
+        emit_read_reg(RAX, XZR_NUM);
+    } else if (op == OP_ADRP) {
+        emit_mov_imm(RAX, PC & ~0xFFFUL);
+    } else {
+        emit_read_reg(RAX, di->src1);
+    }
+
+    // val_b or the immediate in rcx
+    if (di->X_sigs.valb_sel)
+        emit_read_reg(RCX, op == OP_MVN ? di->src1 : di->src2);
+    else
+        emit_mov_imm(RCX, (uint64_t) di->imm);
+
+    switch (di->ALU_op) {
+        case PLUS_OP:   EMIT(0x48, 0x01, 0xC8); break;          // add rax, rcx
+        case MINUS_OP:  EMIT(0x48, 0x29, 0xC8); break;          // sub rax, rcx
+        case AND_OP:    EMIT(0x48, 0x21, 0xC8); break;          // and rax, rcx
+        case OR_OP:     EMIT(0x48, 0x09, 0xC8); break;          // or rax, rcx
+        case EOR_OP:    EMIT(0x48, 0x31, 0xC8); break;          // xor rax, rcx
+        case INV_OP:    EMIT(0x48, 0xF7, 0xD1,                  // not rcx
+                             0x48, 0x09, 0xC8); break;          // or rax, rcx
+        case MOV_OP:
+            EMIT(0x48, 0xC1, 0xE1);                             // shl rcx, val_hw
+            emit8(val_hw);
+            EMIT(0x48, 0x09, 0xC8);                             // or rax, rcx
+            break;
+        case LSL_OP:    EMIT(0x48, 0xD3, 0xE0); break;          // shl rax, cl
+        case LSR_OP:    EMIT(0x48, 0xD3, 0xE8); break;          // shr rax, cl
+        case ASR_OP:    EMIT(0x48, 0xD3, 0xF8); break;          // sar rax, cl
+        case PASS_A_OP: break;
+        default:        emit_read_reg(RAX, XZR_NUM); break;     // alu leaves val_e alone
+    }
+
+    if (di->W_sigs.w_enable)
+        emit_write_reg(RAX, di->dst);
+    if (di->X_sigs.set_flags)
+        emit_flags(di->ALU_op);
+}
+
+static void emit_mem(const decoded_insn_t *di, uint64_t PC, unsigned n) {
+    uint8_t *ok;
+
+    emit_read_reg(RDI, di->src1);
+    EMIT(0x48, 0x81, 0xC7);                         // add rdi, imm32
+    emit32((uint32_t) di->imm);
+    if (di->op == OP_STUR) {
+        emit_read_reg(RSI, di->dst);
+        emit_mov_imm(RDX, PC);
+        emit_call(dbt_store);
+        EMIT(0x85, 0xC0);                           // test eax, eax
+    } else {
+        emit_mov_imm(RSI, PC);
+        emit_call(dbt_load);
+        EMIT(0x48, 0x85, 0xD2);                     // test rdx, rdx
+    }
+    ok = emit_jcc(CC_NE);
+    emit_exit(PC, n, EXIT_INTERP);
+    patch_rel32(ok, t->code_ptr);
+    if (di->W_sigs.w_enable)
+        emit_write_reg(RAX, di->dst);
+}
+
+static void emit_b_cond(const decoded_insn_t *di, uint64_t PC, unsigned n) {
+    uint64_t target = PC + bitfield_s64(di->insnbits, 5, 19) * 4;
+    uint32_t mask = cond_mask(bitfield_u32(di->insnbits, 0, 4));
+    uint8_t *not_taken;
+
+    if (mask == 0xFFFF) {
+        emit_exit_chained(target, n + 1);
+        return;
+    }
+    EMIT(0x0F, 0xB6, 0x83);                         // movzx eax, byte [rbx + NZCV]
+    emit32(offsetof(proc_t, NZCV));
+    emit_mov_imm(RCX, mask);
+    EMIT(0x0F, 0xA3, 0xC1);                         // bt ecx, eax
+    not_taken = emit_jcc(CC_AE);
+    emit_exit_chained(target, n + 1);
+    patch_rel32(not_taken, t->code_ptr);
+    emit_exit_chained(PC + 4, n + 1);
+}
+
+static void emit_ret(const decoded_insn_t *di, uint64_t PC, unsigned n) {
+    uint8_t *halt;
+
+    emit_read_reg(RAX, bitfield_u32(di->insnbits, 5, 5));
+    // Returning from main halts the machine; leave that to the interpreter.
+    emit_mov_imm(RCX, RET_FROM_MAIN_ADDR);
+    EMIT(0x48, 0x39, 0xC8);                         // cmp rax, rcx
+    halt = emit_jcc(CC_E);
+    emit_store_proc(RAX, offsetof(proc_t, PC));
+    emit_retire(n + 1);
+    emit_mov_imm(RAX, EXIT_LOOKUP);
+    emit_jmp(t->dbt_epilogue);
+    patch_rel32(halt, t->code_ptr);
+    emit_exit(PC, n, EXIT_INTERP);
+}
+
+// Translate the instruction at PC, the nth of its block.
+static int emit_insn(uint64_t PC, unsigned n) {
+    bool imem_err = false;
+    const decoded_insn_t *di;
+
+    if (!PC)
+        return INSN_NONE;
+    di = predecode(PC, &imem_err);
+    if (imem_err)
+        return INSN_NONE;
+
+    switch (di->op) {
+        case OP_NOP:
+            return INSN_NEXT;
+        case OP_BL:
+            emit_mov_imm(RAX, PC + 4);
+            emit_write_reg(RAX, 30);
+            /* fall through */
+        case OP_B:
+            emit_exit_chained(PC + bitfield_s64(di->insnbits, 0, 26) * 4, n + 1);
+            return INSN_END;
+        case OP_B_COND:
+            emit_b_cond(di, PC, n);
+            return INSN_END;
+        case OP_RET:
+            emit_ret(di, PC, n);
+            return INSN_END;
+        case OP_LDUR:
+        case OP_STUR:
+            emit_mem(di, PC, n);
+            return INSN_NEXT;
+        case OP_ADD_RI:
+        case OP_SUB_RI:
+        case OP_ADDS_RR:
+        case OP_CMN_RR:
+        case OP_SUBS_RR:
+        case OP_CMP_RR:
+        case OP_ORR_RR:
+        case OP_EOR_RR:
+        case OP_ANDS_RR:
+        case OP_TST_RR:
+        case OP_LSL:
+        case OP_LSR:
+        case OP_ASR:
+        case OP_MVN:
+        case OP_MOVZ:
+        case OP_MOVK:
+        case OP_ADRP:
+            emit_alu(di, PC);
+            return INSN_NEXT;
+        default:
+            return INSN_NONE;
+    }
+}
+
+static uint8_t *lookup(uint64_t PC) {
+    for (unsigned i = (PC >> 2) & (DBT_MAP_SIZE - 1); t->map[i].code; i = (i + 1) & (DBT_MAP_SIZE - 1)) {
+        if (t->map[i].PC == PC)
+            return t->map[i].code;
+    }
+    return NULL;
+}
+
+static void insert(uint64_t PC, uint8_t *code) {
+    unsigned i = (PC >> 2) & (DBT_MAP_SIZE - 1);
+    while (t->map[i].code)
+        i = (i + 1) & (DBT_MAP_SIZE - 1);
+    t->map[i].PC = PC;
+    t->map[i].code = code;
+    t->map_used++;
+}
+
+static void flush(void) {
+    memset(t->map, 0, sizeof(t->map));
+    t->map_used = 0;
+    t->code_ptr = t->code_start;
+    t->epoch++;
+}
+
+static uint8_t *translate(const uint64_t start) {
+    uint8_t *block, *count, *limit;
+    uint64_t PC = start;
+    unsigned n = 0;
+
+    if (t->code_ptr + (DBT_MAX_BLOCK + 2) * DBT_INSN_BYTES > t->code_base + DBT_CODE_SIZE
+        || t->map_used >= DBT_MAP_SIZE / 2)
+        flush();
+    block = t->code_ptr;
+
+    // Don't start the block if it could run past the instruction limit.
+    EMIT(0x49, 0x8D, 0x84, 0x24);                   // lea rax, [r12 + n]
+    count = emit_rel32();
+    EMIT(0x4C, 0x39, 0xF0);                         // cmp rax, r14
+    limit = emit_jcc(CC_A);
+
+    for (;;) {
+        int res;
+        if (n == DBT_MAX_BLOCK) {
+            emit_exit_chained(PC, n);
+            break;
+        }
+        res = emit_insn(PC, n);
+        if (res == INSN_NONE) {
+            emit_exit(PC, n, EXIT_INTERP);
+            break;
+        }
+        n++;
+        if (res == INSN_END)
+            break;
+        PC += 4;
+    }
+    memcpy(count, &n, 4);
+    patch_rel32(limit, t->code_ptr);
+    emit_exit(start, 0, EXIT_INTERP);
+
+    insert(start, block);
+    return block;
+}
+
+static bool dbt_init(void) {
+    if ((t = cur_guest->dbt))
+        return true;
+    uint8_t *code = mmap(NULL, DBT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        return false;
+    t = cur_guest->dbt = calloc(1, sizeof(struct dbt));
+    t->code_base = code;
+    t->code_ptr = t->code_base;
+
+    // dbt_enter(proc, code, state): save callee-saved registers, load the
+    // guest base and counters, and jump into the block.
+    t->dbt_enter = (dbt_enter_t) t->code_ptr;
+    EMIT(0x53, 0x55, 0x41, 0x54, 0x41, 0x55,       // push rbx, rbp, r12, r13
+         0x41, 0x56, 0x41, 0x57,                    // push r14, r15
+         0x48, 0x83, 0xEC, 0x08,                    // sub rsp, 8
+         0x48, 0x89, 0xFB,                          // mov rbx, rdi
+         0x49, 0x89, 0xD5,                          // mov r13, rdx
+         0x4D, 0x8B, 0x65, 0x00,                    // mov r12, [r13 + icount]
+         0x4D, 0x8B, 0x75, 0x08,                    // mov r14, [r13 + limit]
+         0xFF, 0xE6);                               // jmp rsi
+
+    // Every exit ends here with its return value in rax.
+    t->dbt_epilogue = t->code_ptr;
+    EMIT(0x4D, 0x89, 0x65, 0x00,                    // mov [r13 + icount], r12
+         0x48, 0x83, 0xC4, 0x08,                    // add rsp, 8
+         0x41, 0x5F, 0x41, 0x5E,                    // pop r15, r14
+         0x41, 0x5D, 0x41, 0x5C,                    // pop r13, r12
+         0x5D, 0x5B, 0xC3);                         // pop rbp, rbx; ret
+
+    t->code_start = t->code_ptr;
+    return true;
+}
+
+uint64_t dbt_run(const uint64_t max_instr) {
+    // Like the interpreter, the translator has no timing model.
+    cache_t *cache = cur_guest->cache;
+    uint8_t *patch = NULL;
+    uint64_t patch_epoch = 0;
+
+    if (!dbt_init()) {
+        logging(LOG_INFO, "Could not map the translation cache, interpreting instead");
+        return fast_forward(max_instr);
+    }
+
+    cur_guest->cache = NULL;
+    t->state.icount = 0;
+    t->state.limit = max_instr;
+    while (t->state.icount < max_instr) {
+        uint8_t *code = lookup(cur_guest->proc->PC);
+        if (!code)
+            code = translate(cur_guest->proc->PC);
+        // Send the exit we just took straight to this block from now on.
+        if (patch && patch_epoch == t->epoch)
+            patch_rel32(patch, code);
+
+        uintptr_t ret = t->dbt_enter(cur_guest->proc, code, &t->state);
+        if (ret == EXIT_INTERP) {
+            // The block may already have retired up to the limit.
+            patch = NULL;
+            if (t->state.icount >= max_instr || !interp_step())
+                break;
+            t->state.icount++;
+        } else {
+            patch = (uint8_t *) ret;
+            patch_epoch = t->epoch;
+        }
+    }
+    cur_guest->cache = cache;
+    return t->state.icount;
+}
+
+void dbt_free(machine_t *m) {
+    if (!m->dbt)
+        return;
+    munmap(m->dbt->code_base, DBT_CODE_SIZE);
+    free(m->dbt);
+    m->dbt = NULL;
+}
+
+#else
+
+uint64_t dbt_run(const uint64_t max_instr) {
+    logging(LOG_INFO, "Binary translation is only supported on x86-64 hosts, interpreting instead");
+    return fast_forward(max_instr);
+}
+
+void dbt_free(machine_t *m) {
+}
+
+#endif
@@ -0,0 +1,92 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * dram.c - Main memory timing model.
+ *
+ * Addresses are split, from the top, into row, bank, channel and column:
+ * a row's worth of consecutive bytes shares a row buffer, and the next row's
+ * worth goes to the next channel, then the next bank. Requests are timed in
+ * the order the caches send them. Writebacks of dirty lines are not timed.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "err_handler.h"
+#include "dram.h"
+
+bool parse_dram(const char *s, dram_spec_t *spec) {
+    int len = 0;
+
+    spec->policy = ROW_OPEN;
+    if (sscanf(s, "%u:%u:%u:%u:%u:%u%n", &spec->channels, &spec->banks, &spec->row_bytes,
+               &spec->tRCD, &spec->tCAS, &spec->tRP, &len) != 6
+        || (s[len] && strcmp(s + len, ":open") && strcmp(s + len, ":closed"))) {
+        logging(LOG_ERROR, "Memory must be given as channels:banks:row bytes:tRCD:tCAS:tRP[:open|:closed]");
+        return false;
+    }
+    if (!strcmp(s + len, ":closed"))
+        spec->policy = ROW_CLOSED;
+    if (spec->channels < 1 || spec->banks < 1 || spec->row_bytes < 8
+        || __builtin_popcount(spec->row_bytes) != 1 || spec->tCAS < 1) {
+        logging(LOG_ERROR, "Memory needs a channel, a bank, rows of a power of 2 of at least 8 bytes, and tCAS >= 1.");
+        return false;
+    }
+    return true;
+}
+
+dram_t *create_dram(const dram_spec_t *spec) {
+    dram_t *dram = calloc(1, sizeof(dram_t));
+
+    dram->spec = *spec;
+    dram->banks = calloc((size_t) spec->channels * spec->banks, sizeof(dram_bank_t));
+    dram->bus_free = calloc(spec->channels, sizeof(uint64_t));
+    return dram;
+}
+
+void free_dram(dram_t *dram) {
+    free(dram->banks);
+    free(dram->bus_free);
+    free(dram);
+}
+
+uint64_t dram_access(dram_t *dram, uint64_t addr, uint64_t cycle) {
+    const dram_spec_t *spec = &dram->spec;
+    uint64_t chunk = addr / spec->row_bytes;
+    unsigned channel = chunk % spec->channels;
+    unsigned bank_index = chunk / spec->channels % spec->banks;
+    uint64_t row = chunk / spec->channels / spec->banks;
+    dram_bank_t *bank = &dram->banks[channel * spec->banks + bank_index];
+    uint64_t start = cycle > bank->ready ? cycle : bank->ready;
+    uint64_t data;
+
+    if (bank->open && bank->row == row) {
+        dram->row_hits++;
+        data = start + spec->tCAS;
+    } else if (!bank->open) {
+        dram->row_empty++;
+        data = start + spec->tRCD + spec->tCAS;
+    } else {
+        dram->row_conflicts++;
+        data = start + spec->tRP + spec->tRCD + spec->tCAS;
+    }
+    // The line then waits for the channel's bus, and holds it for a burst.
+    if (data < dram->bus_free[channel])
+        data = dram->bus_free[channel];
+    dram->bus_free[channel] = data + DRAM_BURST;
+
+    if (spec->policy == ROW_OPEN) {
+        bank->open = true;
+        bank->row = row;
+        bank->ready = data;
+    } else {
+        bank->open = false;
+        bank->ready = data + spec->tRP;
+    }
+    dram->total_latency += data - cycle;
+    return data > cycle ? data - cycle : 1;
+}
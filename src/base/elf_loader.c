@@ -16,6 +16,7 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <elf.h>
@@ -24,9 +25,7 @@
 #include "machine.h"
 #include "ptable.h"
 
-extern machine_t guest;
-
-uint64_t loadElf(const char *fileName) {
+uint64_t loadElf(machine_t *m, const char *fileName) {
     logging(LOG_INFO, "Loading ELF executable");
     // Open the file.
     int fd = open(fileName, O_RDONLY);
@@ -73,26 +72,35 @@ uint64_t loadElf(const char *fileName) {
             int write = !!(progHeader->p_flags & 0x2);
             int exec = !!(progHeader->p_flags & 0x1);
 
-            // Map data from the file for this segment
-            for (uint64_t j = 0; j < filesz + v_align; j++) {
+            // Map data from the file for this segment, one page at a time.
+            // Whole pages are backed by the mapped file until they are first written;
+            // partial pages and pages already mapped by another segment are copied.
+            for (uint64_t j = 0; j < filesz + v_align; ) {
                 uint64_t addr = vaddr + j;
-                uint8_t byte = dataPtr[j];
                 uint64_t pnum = addr / PAGESIZE;
                 uint64_t poff = addr % PAGESIZE;
-                pte_ptr_t page = get_page(pnum);
-                if (NULL == page)
-                    page = add_page(pnum, read | write << 1 | exec << 2);
-                page->p_data[poff] = byte;
+                uint64_t n = PAGESIZE - poff;
+                if (n > filesz + v_align - j)
+                    n = filesz + v_align - j;
+                pte_ptr_t page = get_page(&m->mem->ptable, pnum);
+                if (NULL == page && n == PAGESIZE) {
+                    add_shared_page(&m->mem->ptable, pnum, read | write << 1 | exec << 2, (char *) dataPtr + j);
+                } else {
+                    if (NULL == page)
+                        page = add_page(&m->mem->ptable, pnum, read | write << 1 | exec << 2);
+                    unshare_page(page);
+                    memcpy(page->p_data + poff, dataPtr + j, n);
+                }
+                j += n;
             }
-            // Map bss address space
-            // Data initialization to 0 happens indirectly through calloc() call in add_page().
+            // Map bss address space, one page at a time.
+            // Its pages share the zero page until they are first written.
             if (memsz > filesz) {
-                for (uint64_t j = 0; j < memsz - filesz; j++) {
-                    uint64_t addr = vaddr + f_align + j;
-                    uint64_t pnum = addr / PAGESIZE;
-                    pte_ptr_t page = get_page(pnum);
-                    if (NULL == page)
-                        page = add_page(pnum, read | write << 1 | exec << 2);
+                uint64_t first = (vaddr + f_align) / PAGESIZE;
+                uint64_t last = (vaddr + f_align + memsz - filesz - 1) / PAGESIZE;
+                for (uint64_t pnum = first; pnum <= last; pnum++) {
+                    if (NULL == get_page(&m->mem->ptable, pnum))
+                        add_shared_page(&m->mem->ptable, pnum, read | write << 1 | exec << 2, zero_page);
                 }
             }       
         }
@@ -109,14 +117,18 @@ uint64_t loadElf(const char *fileName) {
     for (unsigned i = 0; i < entry_count; i++) {
         char *name = strings + sectionHeader->sh_name;
         if (!strcmp(name, ".text")) {
-            guest.mem->seg_start_addr[TEXT_SEG] = sectionHeader->sh_addr;
+            m->mem->seg_start_addr[TEXT_SEG] = sectionHeader->sh_addr;
         }
         if (!strcmp(name, ".data")) {
-            guest.mem->seg_start_addr[DATA_SEG] = sectionHeader->sh_addr;
+            m->mem->seg_start_addr[DATA_SEG] = sectionHeader->sh_addr;
         }
         // print
         sectionHeader = (Elf64_Shdr *) (((uintptr_t) sectionHeader) + entry_size);
     }
 
+    // The mapping stays until free_machine, as pages may still be backed by it.
+    m->mem->image = (void *) ptr;
+    m->mem->image_size = statBuffer.st_size;
+    close(fd);
     return entry;
 }
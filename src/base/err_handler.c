@@ -17,7 +17,7 @@
 bool terminate = false;
 bool ignore_input = false;
 
-static char printbuf[BUF_LEN];
+static __thread char printbuf[BUF_LEN];
 
 static char *sevnames[LOG_FATAL+2] = {
     "INFO",
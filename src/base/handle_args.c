@@ -13,6 +13,7 @@
 
 #include <getopt.h> // This does the job and keeps VSCode happy.
 #include "archsim.h"
+#include "sweep.h"
 
 static char printbuf[BUF_LEN];
 
@@ -25,6 +26,13 @@ void usage(char *argv[]) {
     printf("  -o <file>  Output. Write the ouput of se to the specified file.\n");
     printf("  -c <file>  Checkpoint. Write a checkpoint of the machine state at the end of exection to the specified file.\n");
     printf("  -l <num>   Limit. Will limit the number of cycles se will run for to <num> cycles, default value is 500.\n");
+    printf("  -f <num>   Fast-forward. Run the first <num> instructions in the functional interpreter, then switch to the pipeline.\n");
+    printf("  -x <mode>  Execution mode. pipe (the default) runs the cycle-level pipeline. func and dbt run the program\n");
+    printf("             functionally, with the interpreter or the binary translator, and use the pipeline only to retire\n");
+    printf("             the final instruction. -l then limits the number of instructions, and the cache is not modeled.\n");
+    printf("  -s <list>  Sweep. Simulate every cache configuration in <list>, given as A:B:C:d,A:B:C:d,..., in a single run\n");
+    printf("             of the pipeline, and print the cycles, hits and misses each would have had as CSV. The -A, -B, -C\n");
+    printf("             and -d options are ignored.\n");
     printf("  -v [0-3]   Verbosity. Controls how much diagnostic output you will see, valid values for <num> are 0 - 3.\n");
     printf("             Here is a desription of each level:\n");
     printf("       0: No ouputs. (this is the default value if this flag is not specified)\n");
@@ -35,6 +43,32 @@ void usage(char *argv[]) {
     printf("  -B <num>   Block size. The line size of the cache to use.\n");
     printf("  -C <num>   Capacity. The total capacity of the cache to use.\n");
     printf("  -d <num>   Delay. The number of cycles to stall for when a cache miss occurs.\n");
+    printf("  -r <name>  Replacement. The cache's replacement policy: lru (the default), plru, nru, srrip, brrip or random.\n");
+    printf("             Also applies to every configuration of a -s sweep.\n");
+    printf("  -m <num>   MSHRs. Make the cache non-blocking, with up to <num> misses outstanding (at most %d). Store misses\n", MAX_MSHRS);
+    printf("             no longer stall, later hits proceed under them, and loads missing on a line already on its way\n");
+    printf("             wait only for the rest of its delay. The default, 0, is a blocking cache. Ignored by -s.\n");
+    printf("  -w <num>   Write buffer. Hold up to <num> lines (at most %d) on their way between the data cache and memory:\n", MAX_WBUF);
+    printf("             dirty lines it evicts, and in a blocking cache the stores that missed, so that only a store\n");
+    printf("             finding it full waits for its miss. Later misses are served from it. Ignored by -s.\n");
+    printf("  -I <A:B:C> Instruction cache. Give fetch an L1 instruction cache. A miss in it bubbles decode until the\n");
+    printf("             line arrives, which takes as long as a data cache miss to the same line would.\n");
+    printf("  -L <list>  Lower levels. Add an L2, and optionally an L3, shared by the L1 caches, given as A:B:C:d[,A:B:C:d].\n");
+    printf("             A miss adds the d of every level it looks in, and the L1 data cache's d if no level holds the line.\n");
+    printf("  -H <name>  Inclusion. How the lower levels share lines with the ones above them: non-inclusive (the default),\n");
+    printf("             inclusive (evicting a line from a lower level evicts it from the levels above) or exclusive (a line\n");
+    printf("             moves up on a hit, and L1 victims move down).\n");
+    printf("             -I, -L and -H need the L1 data cache (-A, -B, -C and -d) and are ignored by -s.\n");
+    printf("  -p <name>  Prefetcher. Fetch data cache lines ahead of use: none (the default), next-line (the lines after one\n");
+    printf("             that missed), stride (along a load or store's repeating stride) or stream (along a run of misses).\n");
+    printf("             Ignored by -s.\n");
+    printf("  -P <num>   Prefetch degree. The number of lines each prefetch trigger asks for, 1 to %d, default 1.\n", MAX_PREFETCH_DEGREE);
+    printf("  -D <spec>  DRAM. Time the misses that reach memory with a model of channels:banks:row bytes:tRCD:tCAS:tRP,\n");
+    printf("             optionally followed by :open (the default) or :closed for the row policy, instead of taking d\n");
+    printf("             cycles each. Also applies to every configuration of a -s sweep.\n");
+    printf("  -T         Tag-only. The cache tracks tags, dirty bits and replacement state but holds no data, which stays in\n");
+    printf("             memory. Cycles, hits and misses are unchanged, and the checkpoint shows every store in memory\n");
+    printf("             rather than only those written back from the cache.\n");
     printf("NOTE: If any of the cache aguments are defined then all of them must be defined. The cache configuration must also be valid, if either of these conditions are not met then se will run without a cache.\n");
 }
 
@@ -51,8 +85,9 @@ void handle_args(int argc, char **argv) {
     B = -1;
     C = -1;
     d = -1;
+    prefetch_degree = 1;
 
-    while ((option = getopt(argc, argv, "hi:o:c:l:v:A:B:C:d:")) != -1) {
+    while ((option = getopt(argc, argv, "hi:o:c:l:f:x:s:v:A:B:C:d:r:m:w:I:L:H:p:P:D:T")) != -1) {
         switch(option) {
             case 'h':
                 usage(argv);
@@ -82,6 +117,34 @@ void handle_args(int argc, char **argv) {
                 sprintf(printbuf, "Max cycles set to %ld.", cycle_max);
                 logging(LOG_INFO, printbuf);
                 break;
+            case 'f':
+                ffwd_max = atol(optarg);
+                sprintf(printbuf, "Fast-forwarding %ld instructions.", ffwd_max);
+                logging(LOG_INFO, printbuf);
+                break;
+            case 'x':
+                if (!strcmp(optarg, "pipe")) {
+                    exec_mode = EXEC_PIPE;
+                } else if (!strcmp(optarg, "func")) {
+                    exec_mode = EXEC_FUNC;
+                } else if (!strcmp(optarg, "dbt")) {
+                    exec_mode = EXEC_DBT;
+                } else {
+                    sprintf(printbuf, "Invalid execution mode, options are pipe, func, and dbt. Defaulting to pipe.");
+                    logging(LOG_INFO, printbuf);
+                    exec_mode = EXEC_PIPE;
+                    break;
+                }
+                assert(strlen(optarg) < BUF_LEN);
+                sprintf(printbuf, "Execution mode set to %s.", optarg);
+                logging(LOG_INFO, printbuf);
+                break;
+            case 's':
+                if ((num_sweep = parse_cache_specs(optarg, sweep_specs, SWEEP_MAX, true)) == 0)
+                    exit(EXIT_FAILURE);
+                sprintf(printbuf, "Sweeping %u cache configurations.", num_sweep);
+                logging(LOG_INFO, printbuf);
+                break;
             case 'v':
                 sprintf(printbuf, "Verbose debug logging enabled.");
                 logging(LOG_INFO, printbuf);
@@ -126,6 +189,65 @@ void handle_args(int argc, char **argv) {
             case 'd':
                 d = atoi(optarg);
                 break;
+            case 'r':
+                if (!parse_replacement(optarg, &replacement)) {
+                    logging(LOG_ERROR, "Invalid replacement policy, options are lru, plru, nru, srrip, brrip and random.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'm':
+                mshrs = atoi(optarg);
+                if (mshrs > MAX_MSHRS) {
+                    sprintf(printbuf, "At most %d MSHRs are supported.", MAX_MSHRS);
+                    logging(LOG_ERROR, printbuf);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'w':
+                wbuf = atoi(optarg);
+                if (wbuf > MAX_WBUF) {
+                    sprintf(printbuf, "A write buffer can hold at most %d lines.", MAX_WBUF);
+                    logging(LOG_ERROR, printbuf);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'I':
+                if (parse_cache_specs(optarg, &icache_spec, 1, false) == 0)
+                    exit(EXIT_FAILURE);
+                have_icache = true;
+                break;
+            case 'L':
+                if ((num_outer = parse_cache_specs(optarg, outer_specs, MAX_OUTER, true)) == 0)
+                    exit(EXIT_FAILURE);
+                break;
+            case 'H':
+                if (!parse_inclusion(optarg, &inclusion)) {
+                    logging(LOG_ERROR, "Invalid inclusion policy, options are non-inclusive, inclusive and exclusive.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'p':
+                if (!parse_prefetcher(optarg, &prefetch)) {
+                    logging(LOG_ERROR, "Invalid prefetcher, options are none, next-line, stride and stream.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'P':
+                prefetch_degree = atoi(optarg);
+                if (prefetch_degree < 1 || prefetch_degree > MAX_PREFETCH_DEGREE) {
+                    sprintf(printbuf, "The prefetch degree must be between 1 and %d.", MAX_PREFETCH_DEGREE);
+                    logging(LOG_ERROR, printbuf);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'D':
+                if (!parse_dram(optarg, &dram_spec))
+                    exit(EXIT_FAILURE);
+                have_dram = true;
+                break;
+            case 'T':
+                tag_only = true;
+                break;
             default:
                 sprintf(printbuf, "Ignoring unknown option %c", optopt);
                 logging(LOG_INFO, printbuf);
@@ -138,9 +260,41 @@ void handle_args(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
     
-    if (A == -1 || B == -1 || C == -1 || d == -1) {
+    if (num_sweep) {
+        // The pipeline itself runs without a cache; the sweep models them all.
+        A = B = C = d = -1;
+        if (mshrs) {
+            sprintf(printbuf, "Cache sweeps model blocking caches, ignoring -m.");
+            logging(LOG_WARNING, printbuf);
+            mshrs = 0;
+        }
+        if (wbuf) {
+            sprintf(printbuf, "Cache sweeps model caches without a write buffer, ignoring -w.");
+            logging(LOG_WARNING, printbuf);
+            wbuf = 0;
+        }
+        if (have_icache || num_outer) {
+            sprintf(printbuf, "Cache sweeps model a single level, ignoring -I and -L.");
+            logging(LOG_WARNING, printbuf);
+            have_icache = false;
+            num_outer = 0;
+        }
+        if (prefetch != PREFETCH_NONE) {
+            sprintf(printbuf, "Cache sweeps do not prefetch, ignoring -p.");
+            logging(LOG_WARNING, printbuf);
+            prefetch = PREFETCH_NONE;
+        }
+        if (exec_mode != EXEC_PIPE) {
+            sprintf(printbuf, "Cache sweeps need the pipeline, ignoring -s.");
+            logging(LOG_WARNING, printbuf);
+        }
+    } else if (A == -1 || B == -1 || C == -1 || d == -1) {
         sprintf(printbuf, "Missing arguments for cache creation, running without cache.");
         logging(LOG_INFO, printbuf);
+        if (have_icache || num_outer || have_dram) {
+            sprintf(printbuf, "The cache hierarchy needs an L1 data cache, ignoring -I, -L and -D.");
+            logging(LOG_WARNING, printbuf);
+        }
     } else if (__builtin_popcountll(C / (A * B)) != 1) {
         sprintf(printbuf, "Invalid cache configuration; the number of sets must be a power of 2.");
         logging(LOG_INFO, printbuf);
@@ -15,14 +15,13 @@
 #include "machine.h"
 #include "err_handler.h"
 
-extern machine_t guest;
 
 comb_logic_t 
 imem(uint64_t imem_addr,
      uint32_t *imem_rval, bool *imem_err) {
     // imem_addr must be in "instruction memory" and a multiple of 4
     *imem_err = (!addr_in_imem(imem_addr) || (imem_addr & 0x3U));
-    *imem_rval = (uint32_t) mem_read_I(imem_addr);
+    *imem_rval = (uint32_t) mem_read_I(cur_guest, imem_addr);
 }
 
 comb_logic_t
@@ -32,20 +31,20 @@ regfile(uint8_t src1, uint8_t src2, uint8_t dst, uint64_t val_w,
     // Student TODO
     
     if (src1 < 31 && src1 >= 0) {
-        *val_a = guest.proc->GPR[src1];
+        *val_a = cur_guest->proc->GPR[src1];
     }
     else if (src1 == 31) {
-        *val_a = guest.proc->SP;
+        *val_a = cur_guest->proc->SP;
     }
     else if (src1 == 32) {
         *val_a = 0;
     }
     
     if (src2 < 31 && src2 >= 0) {
-        *val_b = guest.proc->GPR[src2];
+        *val_b = cur_guest->proc->GPR[src2];
     }
     else if (src2 == 31) {
-        *val_b = guest.proc->SP;
+        *val_b = cur_guest->proc->SP;
     }
     else if (src2 == 32) {
         *val_b = 0;
@@ -54,10 +53,10 @@ regfile(uint8_t src1, uint8_t src2, uint8_t dst, uint64_t val_w,
 
     if (w_enable) {
        if (dst < 31) {
-           guest.proc->GPR[dst] = val_w;
+           cur_guest->proc->GPR[dst] = val_w;
        }   
        else if (dst == 31) {
-           guest.proc->SP = val_w;
+           cur_guest->proc->SP = val_w;
        }
     }
 }
@@ -215,6 +214,6 @@ dmem(uint64_t dmem_addr, uint64_t dmem_wval, bool dmem_read, bool dmem_write,
     // dmem_addr must be in "data memory" and a multiple of 8
     *dmem_err = (!addr_in_dmem(dmem_addr) || (dmem_addr & 0x7U));
     if (is_special_addr(dmem_addr)) *dmem_err = false;
-    if (dmem_read) *dmem_rval = (uint64_t) mem_read_L(dmem_addr);
-    if (dmem_write) mem_write_L(dmem_addr, dmem_wval);
+    if (dmem_read) *dmem_rval = (uint64_t) mem_read_L(cur_guest, dmem_addr);
+    if (dmem_write) mem_write_L(cur_guest, dmem_addr, dmem_wval);
 }
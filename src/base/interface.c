@@ -31,7 +31,6 @@ void init(void) {
     outfile = stdout;
     errfile = stderr;
     if (! hw_prompt) hw_prompt = default_hw_prompt;
-    init_machine();
     init_itable();
     if (outfile != stdout) {
         hw_prompt = "";
@@ -41,15 +40,50 @@ void init(void) {
     return;
 }
 
-void finalize() {
+void finalize(machine_t *m) {
     if (outfile == stdout)  {
         time_t t;
         assert(time(&t) != -1);
         fprintf(outfile, "Run ended at %s\n", ctime(&t));
         fprintf(outfile, ANSI_BOLD "Goodbye!\n\n" ANSI_RESET);
     }
-    if (checkpoint) {
-        log_machine_state();
+    if (m->checkpoint) {
+        log_machine_state(m);
+    }
+    char printbuf[BUF_LEN];
+    // The TLBs are the emulator's own, not part of the machine, so only -v shows them.
+    if (debug_level > 0) {
+        sprintf(printbuf, "TLB hits, misses: instruction %lu, %lu; data %lu, %lu",
+                m->mem->itlb.hits, m->mem->itlb.misses, m->mem->dtlb.hits, m->mem->dtlb.misses);
+        logging(LOG_INFO, printbuf);
+    }
+    if (m->cache) {
+        sprintf(printbuf, "Data cache line lookups that hit, missed: %d, %d",
+                m->cache->hit_count, m->cache->miss_count);
+        logging(LOG_INFO, printbuf);
+    }
+    if (m->cache && m->num_mshrs) {
+        sprintf(printbuf, "MSHR merges, stalls with every MSHR busy: %lu, %lu", m->mshr_merges, m->mshr_full);
+        logging(LOG_INFO, printbuf);
+    }
+    if (m->cache && m->wbuf_size) {
+        sprintf(printbuf, "Write buffer stores, writebacks, forwards, stalls when full: %lu, %lu, %lu, %lu",
+                m->wbuf_stores, m->wbuf_victims, m->wbuf_forwards, m->wbuf_full);
+        logging(LOG_INFO, printbuf);
+    }
+    if (m->cache && m->dram) {
+        dram_t *dram = m->dram;
+        uint64_t requests = dram->row_hits + dram->row_empty + dram->row_conflicts;
+        sprintf(printbuf, "DRAM row hits, empty rows, conflicts: %lu, %lu, %lu; mean latency %.1f",
+                dram->row_hits, dram->row_empty, dram->row_conflicts,
+                requests ? (double) dram->total_latency / requests : 0.0);
+        logging(LOG_INFO, printbuf);
+    }
+    if (m->cache && m->prefetcher) {
+        prefetcher_t *pf = m->prefetcher;
+        sprintf(printbuf, "Prefetches issued, useful, late, polluting, dropped: %lu, %lu, %lu, %lu, %lu",
+                pf->issued, pf->useful, pf->late, pf->polluting, pf->dropped);
+        logging(LOG_INFO, printbuf);
     }
     return;
 }
@@ -0,0 +1,142 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * interp.c - Functional interpreter used to fast-forward a program.
+ *
+ * Each instruction is decoded through the predecode cache shared with the
+ * Fetch and Decode stages and executed with the alu, regfile and dmem hardware
+ * elements, so the architectural state after N instructions is exactly what
+ * the pipeline would have produced. Anything the interpreter does not model
+ * (halts, faults, unsupported opcodes) is left for the pipeline to handle.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include "archsim.h"
+#include "hw_elts.h"
+#include "interp.h"
+#include "predecode.h"
+
+#define SP_NUM 31
+#define XZR_NUM 32
+
+
+static void write_reg(uint8_t dst, uint64_t val) {
+    if (dst < SP_NUM)
+        cur_guest->proc->GPR[dst] = val;
+    else if (dst == SP_NUM)
+        cur_guest->proc->SP = val;
+}
+
+bool interp_step(void) {
+    uint64_t PC = cur_guest->proc->PC;
+    uint64_t next_PC = PC + 4;
+    bool imem_err = false;
+
+    if (!PC)
+        return false;
+    const decoded_insn_t *di = predecode(PC, &imem_err);
+    if (imem_err || di->op == OP_ERROR)
+        return false;
+
+    opcode_t op = di->op;
+    uint32_t insnbits = di->insnbits;
+    uint8_t dst = di->dst;
+    uint64_t val_a = 0, val_b = 0, val_e = 0;
+    uint8_t val_hw = 0;
+    bool cond_val = true;
+    uint8_t nzcv = cur_guest->proc->NZCV;
+
+    regfile(di->src1, di->src2, dst, 0, false, &val_a, &val_b);
+
+    switch (op) {
+        case OP_NOP:
+            break;
+        case OP_B:
+            next_PC = PC + bitfield_s64(insnbits, 0, 26) * 4;
+            break;
+        case OP_BL:
+            write_reg(30, PC + 4);
+            next_PC = PC + bitfield_s64(insnbits, 0, 26) * 4;
+            break;
+        case OP_B_COND:
+            alu(0, 0, 0, PASS_A_OP, false, bitfield_u32(insnbits, 0, 4), &val_e, &cond_val, &nzcv);
+            if (cond_val)
+                next_PC = PC + bitfield_s64(insnbits, 5, 19) * 4;
+            break;
+        case OP_RET:
+            regfile(bitfield_u32(insnbits, 5, 5), XZR_NUM, 0, 0, false, &next_PC, &val_b);
+            // Returning from main halts the machine; let the pipeline do that.
+            if (next_PC == RET_FROM_MAIN_ADDR)
+                return false;
+            break;
+        case OP_LDUR:
+        case OP_STUR: {
+            // The M-format offset is the predecoded immediate, which Decode passes to Execute as val_imm.
+            uint64_t addr = val_a + di->imm;
+            uint64_t rval = 0;
+            bool dmem_err = false;
+            if (!is_special_addr(addr) && (!addr_in_dmem(addr) || (addr & 0x7U)))
+                return false;
+            regfile(XZR_NUM, dst, 0, 0, false, &rval, &val_b);
+            dmem(addr, val_b, di->M_sigs.dmem_read, di->M_sigs.dmem_write, &rval, &dmem_err);
+            if (di->W_sigs.w_enable)
+                write_reg(dst, rval);
+            break;
+        }
+        case OP_ADD_RI:
+        case OP_SUB_RI:
+        case OP_ADDS_RR:
+        case OP_CMN_RR:
+        case OP_SUBS_RR:
+        case OP_CMP_RR:
+        case OP_ORR_RR:
+        case OP_EOR_RR:
+        case OP_ANDS_RR:
+        case OP_TST_RR:
+        case OP_LSL:
+        case OP_LSR:
+        case OP_ASR:
+        case OP_MVN:
+        case OP_MOVZ:
+        case OP_MOVK:
+        case OP_ADRP:
+            if (op == OP_MOVZ || op == OP_MOVK) {
+                val_hw = bitfield_u32(insnbits, 21, 2) * 16;
+                val_a = (op == OP_MOVK && dst < SP_NUM) ? cur_guest->proc->GPR[dst] & ~(0xFFFFULL << val_hw) : 0;
+            } else if (op == OP_MVN) {
+                val_b = val_a;
+                val_a = 0;
+            } else if (op == OP_ADRP) {
+                val_a = PC & ~0xFFFUL;
+            }
+            alu(val_a, di->X_sigs.valb_sel ? val_b : (uint64_t) di->imm, val_hw, di->ALU_op,
+                di->X_sigs.set_flags, C_AL, &val_e, &cond_val, &nzcv);
+            if (di->X_sigs.set_flags)
+                cur_guest->proc->NZCV = nzcv;
+            if (di->W_sigs.w_enable)
+                write_reg(dst, val_e);
+            break;
+        default:
+            // HLT and anything the pipeline treats specially.
+            return false;
+    }
+
+    cur_guest->proc->PC = next_PC;
+    return true;
+}
+
+uint64_t fast_forward(const uint64_t max_instr) {
+    // Memory is accessed without any timing model, so the cache starts cold
+    // when the pipeline takes over.
+    cache_t *cache = cur_guest->cache;
+    uint64_t count = 0;
+
+    cur_guest->cache = NULL;
+    while (count < max_instr && interp_step())
+        count++;
+    cur_guest->cache = cache;
+    return count;
+}
@@ -11,19 +11,16 @@
  * May not be used, modified, or copied without permission.
  **************************************************************************/ 
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "machine.h"
+#include <sys/mman.h>
+#include "archsim.h"
+#include "prefetch.h"
+#include "dram.h"
 #include "ptable.h"
-
-/* Created from command-line arguments */
-extern FILE *checkpoint;
-extern int A, B, C, d;
-extern uint64_t inflight_cycles;
-extern uint64_t inflight_addr;
-extern bool inflight;
-extern mem_status_t dmem_status;
-extern uint64_t num_instr;
+#include "predecode.h"
+#include "dbt.h"
 
 // These may be changed by the ELF loader
 uint64_t seg_starts[] = {
@@ -45,33 +42,132 @@ static char *GPR_names64[] = {
 
 static uint8_t seg_prots[] = {0x0, 0x5, 0x6, 0x6, 0x5, 0x6, 0x0};
 
-extern machine_t guest;
+__thread machine_t *cur_guest;
 
 #define NUM_ADDR_BITS 64
 
-void init_machine() {
-    // guest.name = malloc(strlen(name)+1);
-    // strcpy(guest.name, name);
+void init_machine(machine_t *m, int A, int B, int C, int d, bool tag_only, replacement_t policy) {
+    // m->name = malloc(strlen(name)+1);
+    // strcpy(m->name, name);
+    memset(m, 0, sizeof(machine_t));
 
-    guest.proc = calloc(1, sizeof(proc_t));
+    m->proc = calloc(1, sizeof(proc_t));
     
-    guest.mem = malloc(sizeof(mem_t));
-    guest.mem->max_addr = UINT_FAST64_MAX;
-    guest.mem->addr_size = NUM_ADDR_BITS;
+    m->mem = calloc(1, sizeof(mem_t));
+    m->mem->max_addr = UINT_FAST64_MAX;
+    m->mem->addr_size = NUM_ADDR_BITS;
     for (int i = 0; i <= KERNEL_SEG; i++) {
-        guest.mem->seg_start_addr[i] = seg_starts[i];
-        guest.mem->seg_prot[i] = seg_prots[i];
+        m->mem->seg_start_addr[i] = seg_starts[i];
+        m->mem->seg_prot[i] = seg_prots[i];
     }
     if (A == -1 || B == -1 || C == -1 || d == -1) {
-        guest.cache = NULL;
+        m->cache = NULL;
     }
     else {
-        guest.cache = create_cache(A, B, C, d);
-        inflight_cycles = guest.cache->d;
-        inflight_addr = 0;
-        inflight = false;
-        dmem_status = READY;
+        m->cache = create_cache_policy(A, B, C, d, policy, !tag_only);
+        m->inflight_cycles = m->cache->d;
+        m->inflight_addr = 0;
+        m->inflight = false;
+    }
+    m->policy = policy;
+    m->dmem_status = READY;
+    m->predecode = calloc(PREDECODE_SIZE + 1, sizeof(decoded_insn_t));
+    cur_guest = m;
+}
+
+unsigned parse_cache_specs(const char *list, cache_spec_t *specs, unsigned max, bool with_d) {
+    char printbuf[BUF_LEN];
+    const char *p = list;
+    unsigned n = 0;
+
+    while (*p) {
+        cache_spec_t *spec = &specs[n];
+        int len = 0;
+        if (n == max) {
+            sprintf(printbuf, "At most %u cache configurations can be given here.", max);
+            logging(LOG_ERROR, printbuf);
+            return 0;
+        }
+        spec->d = 1;
+        if ((with_d ? sscanf(p, "%d:%d:%d:%d%n", &spec->A, &spec->B, &spec->C, &spec->d, &len) != 4
+                    : sscanf(p, "%d:%d:%d%n", &spec->A, &spec->B, &spec->C, &len) != 3)
+            || (p[len] != ',' && p[len] != '\0')) {
+            logging(LOG_ERROR, with_d ? "Cache configurations must be given as A:B:C:d,A:B:C:d,..."
+                                      : "Cache configurations must be given as A:B:C");
+            return 0;
+        }
+        if (spec->A < 1 || spec->B < 8 || __builtin_popcountll(spec->B) != 1 || spec->C < spec->A * spec->B
+            || __builtin_popcountll(spec->C / (spec->A * spec->B)) != 1 || spec->d < 1) {
+            sprintf(printbuf, "Invalid cache configuration %d:%d:%d:%d.", spec->A, spec->B, spec->C, spec->d);
+            logging(LOG_ERROR, printbuf);
+            return 0;
+        }
+        n++;
+        p += len;
+        if (*p == ',')
+            p++;
     }
+    return n;
+}
+
+static char *inclusion_names[] = {"non-inclusive", "inclusive", "exclusive"};
+
+bool parse_inclusion(const char *name, inclusion_t *inclusion) {
+    for (int i = 0; i <= EXCLUSIVE; i++) {
+        if (!strcmp(name, inclusion_names[i])) {
+            *inclusion = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void init_hierarchy(machine_t *m, const cache_spec_t *icache, const cache_spec_t *outer,
+                    unsigned num_outer, inclusion_t inclusion) {
+    // Only the L1 data cache holds data; below it, memory is always current.
+    if (icache)
+        m->icache = create_cache_policy(icache->A, icache->B, icache->C, 1, m->policy, false);
+    for (unsigned i = 0; i < num_outer; i++)
+        m->outer[i] = create_cache_policy(outer[i].A, outer[i].B, outer[i].C, outer[i].d, m->policy, false);
+    m->num_outer = num_outer;
+    m->inclusion = inclusion;
+    m->ifetch_line = ~0ULL;
+    m->ifetch_ready = 0;
+}
+
+void free_machine(machine_t *m) {
+    if (m->proc->f_insn) {
+        pipe_reg_t *pipes[] = {m->proc->f_insn, m->proc->d_insn, m->proc->x_insn,
+                               m->proc->m_insn, m->proc->w_insn};
+        for (int i = 0; i < 5; i++) {
+            free(pipes[i]->in.generic);
+            free(pipes[i]->out.generic);
+            free(pipes[i]);
+        }
+    }
+    free(m->proc);
+    free_ptable(&m->mem->ptable);
+    if (m->mem->image)
+        munmap(m->mem->image, m->mem->image_size);
+    free(m->mem);
+    if (m->cache)
+        free_cache(m->cache);
+    if (m->icache)
+        free_cache(m->icache);
+    for (unsigned i = 0; i < m->num_outer; i++)
+        free_cache(m->outer[i]);
+    if (m->prefetcher)
+        free_prefetcher(m->prefetcher);
+    if (m->dram)
+        free_dram(m->dram);
+    for (int i = 0; i < MAX_MSHRS; i++)
+        free(m->mshrs[i].pending);
+    for (int i = 0; i < MAX_WBUF; i++)
+        free(m->wbuf[i].bytes);
+    free(m->predecode);
+    dbt_free(m);
+    if (cur_guest == m)
+        cur_guest = NULL;
 }
 
 static void get_stat_str(char *str, stat_t status) {
@@ -94,45 +190,59 @@ static void get_stat_str(char *str, stat_t status) {
     }
 }
 
-void log_machine_state() {
-    if (checkpoint) {
-        fprintf(checkpoint, "Machine state checkpoint after %ld cycles:\n", num_instr);
+/*
+ * The checkpoint keeps the counts of the reference emulator, so that test-se
+ * can compare the two. It looked up every byte of an access and looked the
+ * missing byte up again on each cycle of the miss, then reported its misses
+ * divided by d, one per line filled (so none for a miss still in flight), and
+ * its hits less those misses: the bytes accessed less two per miss. Everything
+ * else (the log, -s and se-batch) reports the cache's own counts, one lookup
+ * per line an access touches.
+ */
+static void checkpoint_hits_misses(machine_t *m, int *hits, int *misses) {
+    *misses = m->cache->miss_count - m->inflight;
+    *hits = (int) m->dcache_bytes - 2 * *misses;
+}
+
+void log_machine_state(machine_t *m) {
+    if (m->checkpoint) {
+        fprintf(m->checkpoint, "Machine state checkpoint after %ld cycles:\n", m->num_instr);
         // Log processor state
-        fprintf(checkpoint, "\tProcessor state:\n");
+        fprintf(m->checkpoint, "\tProcessor state:\n");
         // PC and SP
-        fprintf(checkpoint, "\t\tProgram Counter: %lx\n", guest.proc->PC);
-        fprintf(checkpoint, "\t\tStack Pointer: %lx\n", guest.proc->SP);
+        fprintf(m->checkpoint, "\t\tProgram Counter: %lx\n", m->proc->PC);
+        fprintf(m->checkpoint, "\t\tStack Pointer: %lx\n", m->proc->SP);
         // NZCV
-        uint8_t cc = guest.proc->NZCV;
-        fprintf(checkpoint, "\t\tCondition Flags: [N,Z,C,V] = [%x, %x, %x, %x]\n",
+        uint8_t cc = m->proc->NZCV;
+        fprintf(m->checkpoint, "\t\tCondition Flags: [N,Z,C,V] = [%x, %x, %x, %x]\n",
                 GET_NF(cc), GET_ZF(cc), GET_CF(cc), GET_VF(cc));
         // 64-bit registers
-        fprintf(checkpoint, "\t\tGeneral Purpose Register File state:\n");
+        fprintf(m->checkpoint, "\t\tGeneral Purpose Register File state:\n");
         for (int i = 0; i < 31; i++) {
-            fprintf(checkpoint, "\t\t\tRegister %s: %lx\n", GPR_names64[i], guest.proc->GPR[i]);
+            fprintf(m->checkpoint, "\t\t\tRegister %s: %lx\n", GPR_names64[i], m->proc->GPR[i]);
         }
         // status  
         char buf[4];
-        get_stat_str(buf, guest.proc->status);
-        fprintf(checkpoint, "\t\tStatus: %s\n", buf);
+        get_stat_str(buf, m->proc->status);
+        fprintf(m->checkpoint, "\t\tStatus: %s\n", buf);
         // Log memory state
-        fprintf(checkpoint, "\tMemory state:\n");
+        fprintf(m->checkpoint, "\tMemory state:\n");
         /* 
          * .text section
          * This isn't really needed since students don't 
          * write the ELF Loader and shouldn't modify the
          * instructions, but it was useful for debugging.
          */
-        fprintf(checkpoint, "\t\tText segment:\n");
+        fprintf(m->checkpoint, "\t\tText segment:\n");
         pte_ptr_t page;
-        uint64_t addr = guest.mem->seg_start_addr[TEXT_SEG];
+        uint64_t addr = m->mem->seg_start_addr[TEXT_SEG];
         addr -= addr % PAGESIZE;
         uint64_t pnum = addr / PAGESIZE;
-        while ((page = get_page(pnum))) {
+        while ((page = get_page(&m->mem->ptable, pnum))) {
             for (int i = 0; i < PAGESIZE; i += 8) {
                 uint64_t data = *(uint64_t *)(page->p_data + i);
                 if (data) {
-                    fprintf(checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
+                    fprintf(m->checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
                         addr+i, data);
                 }
             }
@@ -140,15 +250,15 @@ void log_machine_state() {
             pnum = addr / PAGESIZE;
         }
         // .data section
-        fprintf(checkpoint, "\t\tData segment:\n");
-        addr = guest.mem->seg_start_addr[DATA_SEG];
+        fprintf(m->checkpoint, "\t\tData segment:\n");
+        addr = m->mem->seg_start_addr[DATA_SEG];
         addr -= addr % PAGESIZE;
         pnum = addr / PAGESIZE;
-        while ((page = get_page(pnum))) {
+        while ((page = get_page(&m->mem->ptable, pnum))) {
             for (int i = 0; i < PAGESIZE; i += 8) {
                 uint64_t data = *(uint64_t *)(page->p_data + i);
                 if (data) {
-                    fprintf(checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
+                    fprintf(m->checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
                         addr+i, data);
                 }
             }
@@ -156,13 +266,13 @@ void log_machine_state() {
             pnum = addr / PAGESIZE;
         }
         // Heap memory
-        fprintf(checkpoint, "\t\tHeap:\n");
-        addr = guest.mem->seg_start_addr[HEAP_SEG];
-        while ((page = get_page(pnum))) {
+        fprintf(m->checkpoint, "\t\tHeap:\n");
+        addr = m->mem->seg_start_addr[HEAP_SEG];
+        while ((page = get_page(&m->mem->ptable, pnum))) {
             for (int i = addr%PAGESIZE; i < PAGESIZE; i += 8) {
                 uint64_t data = *(uint64_t *)(page->p_data + i);
                 if (data) {
-                    fprintf(checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
+                    fprintf(m->checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
                         addr+i, data);
                 }
             }
@@ -170,31 +280,35 @@ void log_machine_state() {
             pnum = addr / PAGESIZE;
         }
         // Stack memory
-        fprintf(checkpoint, "\t\tStack:\n");
-        addr = guest.mem->seg_start_addr[STACK_SEG]-PAGESIZE;
+        fprintf(m->checkpoint, "\t\tStack:\n");
+        addr = m->mem->seg_start_addr[STACK_SEG]-PAGESIZE;
         addr -= addr % PAGESIZE;
         pnum = addr / PAGESIZE;
-        while ((page = get_page(pnum))) {
+        while ((page = get_page(&m->mem->ptable, pnum))) {
             for (int i = addr%PAGESIZE; i < PAGESIZE; i += 8) {
                 uint64_t data = *(uint64_t *)(page->p_data + i);
                 if (data) {
-                    fprintf(checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
+                    fprintf(m->checkpoint, "\t\t\tAddress 0x%lx: 0x%lx\n", 
                         addr+i, data);
                 }
             }
             addr -= PAGESIZE;
             pnum = addr / PAGESIZE;
         }
-        extern int hit_count;
-        extern int miss_count;
-        int hits, misses;
-        // mem.c code for this gives extra hits and misses
-        if (guest.cache) {
-            misses = miss_count / guest.cache->d;
-            hits = hit_count-misses;
-            fprintf(checkpoint, "\t\tNumber of cache hits, misses: %d, %d\n", hits, misses);
+        if (m->cache) {
+            int hits, misses;
+            checkpoint_hits_misses(m, &hits, &misses);
+            fprintf(m->checkpoint, "\t\tNumber of cache hits, misses: %d, %d\n", hits, misses);
+        }
+        if (m->icache) {
+            fprintf(m->checkpoint, "\t\tNumber of L1I cache hits, misses: %d, %d\n",
+                    m->icache->hit_count, m->icache->miss_count);
+        }
+        for (unsigned i = 0; i < m->num_outer; i++) {
+            fprintf(m->checkpoint, "\t\tNumber of L%u cache hits, misses: %d, %d\n", i + 2,
+                    m->outer[i]->hit_count, m->outer[i]->miss_count);
         }
 
-        fprintf(checkpoint, "\n");
+        fprintf(m->checkpoint, "\n");
     }
 }
@@ -15,17 +15,17 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include "err_handler.h"
 #include "mem.h"
 #include "ptable.h"
 #include "machine.h"
+#include "predecode.h"
+#include "sweep.h"
+#include "prefetch.h"
+#include "dram.h"
 
-extern machine_t guest;
-extern uint64_t inflight_cycles;
-extern uint64_t inflight_addr;
-extern bool inflight;
-extern mem_status_t dmem_status;
 extern uint64_t seg_starts[];
 
 const uint64_t NULL_ADDR = 0x0UL;
@@ -35,13 +35,13 @@ const uint64_t RET_FROM_MAIN_ADDR = 0x0UL;
 const uint64_t CHECKPOINT_ADDR = 0xFFFFFFFFFFFFFFFFUL-8;
 
 bool addr_in_imem(const uint64_t addr) {
-    return ((guest.mem->seg_start_addr[TEXT_SEG] <= addr) && 
-            (addr < guest.mem->seg_start_addr[DATA_SEG]));
+    return ((cur_guest->mem->seg_start_addr[TEXT_SEG] <= addr) && 
+            (addr < cur_guest->mem->seg_start_addr[DATA_SEG]));
 }
 
 bool addr_in_dmem(const uint64_t addr) {
-    return ((guest.mem->seg_start_addr[DATA_SEG] <= addr) && 
-            (addr < guest.mem->seg_start_addr[KERNEL_SEG]));
+    return ((cur_guest->mem->seg_start_addr[DATA_SEG] <= addr) && 
+            (addr < cur_guest->mem->seg_start_addr[KERNEL_SEG]));
 }
 
 bool is_special_addr(const uint64_t addr) {
@@ -52,33 +52,83 @@ bool is_special_addr(const uint64_t addr) {
 }
 
 
-static uint8_t get_prot_bits(const uint64_t addr) {
+static uint8_t get_prot_bits(machine_t *m, const uint64_t addr) {
     for (int i = 0; i < KERNEL_SEG; i++) {
-        if ((guest.mem->seg_start_addr[i] <= addr) && 
-            (addr < guest.mem->seg_start_addr[i+1]))
-            return guest.mem->seg_prot[i];
+        if ((m->mem->seg_start_addr[i] <= addr) && 
+            (addr < m->mem->seg_start_addr[i+1]))
+            return m->mem->seg_prot[i];
     }
-    return guest.mem->seg_prot[KERNEL_SEG];
+    return m->mem->seg_prot[KERNEL_SEG];
 }
 
-static uint8_t _mem_read_byte(const uint64_t addr) {
+/*
+ * Find the page holding addr, through the instruction TLB for the text segment
+ * and the data TLB for everything else, materializing the page if needed.
+ * A page about to be written always has a payload of its own.
+ */
+static pte_ptr_t _mem_page(machine_t *m, const uint64_t addr, const bool write) {
     uint64_t pnum = addr / PAGESIZE;
-    uint64_t poff = addr % PAGESIZE;
-    pte_ptr_t page = get_page(pnum);
-    if (NULL == page)
-        page = add_page(pnum, get_prot_bits(addr));
-    return page->p_data[poff];
+    tlb_t *tlb = (addr < m->mem->seg_start_addr[DATA_SEG]) ? &m->mem->itlb : &m->mem->dtlb;
+    unsigned idx = pnum % TLB_SIZE;
+
+    pte_ptr_t page;
+
+    if (tlb->page[idx] != NULL && tlb->pnum[idx] == pnum) {
+        tlb->hits++;
+        page = tlb->page[idx];
+    } else {
+        tlb->misses++;
+        page = get_page(&m->mem->ptable, pnum);
+        // Pages that are only ever read share the zero page.
+        if (NULL == page && write)
+            page = add_page(&m->mem->ptable, pnum, 7);//TODO: FIX.
+        else if (NULL == page)
+            page = add_shared_page(&m->mem->ptable, pnum, get_prot_bits(m, addr), zero_page);
+        tlb->pnum[idx] = pnum;
+        tlb->page[idx] = page;
+    }
+    if (write && page->p_shared)
+        unshare_page(page);
+    return page;
+}
+
+static uint8_t _mem_read_byte(machine_t *m, const uint64_t addr) {
+    return _mem_page(m, addr, false)->p_data[addr % PAGESIZE];
 }
 
-static uint64_t _mem_read_LE(const uint64_t addr, const unsigned width) {
+static uint64_t _mem_read_LE(machine_t *m, const uint64_t addr, const unsigned width) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Within one page, a single lookup and a host load will do.
+    uint64_t poff = addr % PAGESIZE;
+    if (poff + width <= PAGESIZE) {
+        const char *p = _mem_page(m, addr, false)->p_data + poff;
+        switch (width) {
+            case 1: return (uint8_t) *p;
+            case 2: {uint16_t v; memcpy(&v, p, 2); return v;}
+            case 4: {uint32_t v; memcpy(&v, p, 4); return v;}
+            case 8: {uint64_t v; memcpy(&v, p, 8); return v;}
+        }
+    }
+#endif
     uint64_t retval = 0ULL;
     for (int i = width-1; i >= 0; i--)
-        retval = (retval << 8) + _mem_read_byte(addr+i);
+        retval = (retval << 8) + _mem_read_byte(m, addr+i);
     return retval;
 }
 
+/* Copy len bytes starting at addr into buf, looking up each page only once. */
+static void _mem_read_block(machine_t *m, uint64_t addr, uint8_t *buf, size_t len) {
+    while (len > 0) {
+        uint64_t poff = addr % PAGESIZE;
+        size_t n = (len < PAGESIZE - poff) ? len : PAGESIZE - poff;
+        memcpy(buf, _mem_page(m, addr, false)->p_data + poff, n);
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+}
 
-static uint64_t _mem_read_special(const uint64_t addr, const unsigned width) {
+static uint64_t _mem_read_special(machine_t *m, const uint64_t addr, const unsigned width) {
     if (NULL_ADDR == addr) {
         logging(LOG_FATAL, "Null pointer read attempt");
         exit(EXIT_FAILURE);
@@ -98,31 +148,49 @@ static uint64_t _mem_read_special(const uint64_t addr, const unsigned width) {
     }
     if (RET_FROM_MAIN_ADDR == addr) {return 0;}
     if (CHECKPOINT_ADDR == addr) {
-        log_machine_state();
+        log_machine_state(m);
         return 0;
     }
     assert(false); return 0;
 }
 
-static write_ret_code_t _mem_write_byte(const uint64_t addr, const uint8_t data) {
-    uint64_t pnum = addr / PAGESIZE;
-    uint64_t poff = addr % PAGESIZE;
-    pte_ptr_t page = get_page(pnum);
-    if (NULL == page) {
-        page = add_page(pnum, 7);//TODO: FIX.
-    }
-    page->p_data[poff] = data;
+static write_ret_code_t _mem_write_byte(machine_t *m, const uint64_t addr, const uint8_t data) {
+    _mem_page(m, addr, true)->p_data[addr % PAGESIZE] = data;
     return WRITE_SUCCESS;
 }
 
-static write_ret_code_t _mem_write_LE(const uint64_t addr, const uint64_t data, const unsigned width) {
+static write_ret_code_t _mem_write_LE(machine_t *m, const uint64_t addr, const uint64_t data, const unsigned width) {
     uint8_t *s = (uint8_t *) &data;
     write_ret_code_t retval = WRITE_FAILURE;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Within one page, a single lookup and a host store will do.
+    uint64_t poff = addr % PAGESIZE;
+    if (poff + width <= PAGESIZE) {
+        char *p = _mem_page(m, addr, true)->p_data + poff;
+        switch (width) {
+            case 1: *p = (char) data; return WRITE_SUCCESS;
+            case 2: {uint16_t v = data; memcpy(p, &v, 2); return WRITE_SUCCESS;}
+            case 4: {uint32_t v = data; memcpy(p, &v, 4); return WRITE_SUCCESS;}
+            case 8: memcpy(p, &data, 8); return WRITE_SUCCESS;
+        }
+    }
+#endif
     for (int i = 0; i < width; i++)
-        retval |= _mem_write_byte(addr+i, s[i]);
+        retval |= _mem_write_byte(m, addr+i, s[i]);
     return retval;
 }
 
+/* Copy len bytes from buf to memory starting at addr, looking up each page only once. */
+static void _mem_write_block(machine_t *m, uint64_t addr, const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        uint64_t poff = addr % PAGESIZE;
+        size_t n = (len < PAGESIZE - poff) ? len : PAGESIZE - poff;
+        memcpy(_mem_page(m, addr, true)->p_data + poff, buf, n);
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+}
 
 static write_ret_code_t _mem_write_special(const uint64_t addr, const uint64_t data, const unsigned width) {
     if (NULL_ADDR == addr) {
@@ -148,140 +216,681 @@ static write_ret_code_t _mem_write_special(const uint64_t addr, const uint64_t d
     assert(false); return WRITE_SUCCESS;
 }
 
-static uint64_t _mem_read_cache(const uint64_t addr, const unsigned width) {
-    size_t B = guest.cache->B;
-	uword_t current_address = addr;
-    word_t data = 0;
+/*
+ * A write buffer (-w) holds up to wbuf_size lines on their way out of or into
+ * the data cache, so that neither holds up the memory stage: dirty lines
+ * evicted from the cache, which reach memory d cycles later, and, in a
+ * blocking cache, the stores that missed on a line, merged into it once it
+ * arrives. Only a store that finds the buffer full waits for its miss. A miss
+ * on a line being written back takes it straight from the buffer, and a load
+ * that misses on bytes the buffered stores all cover reads them from there.
+ * Entries are retired, oldest first, before an access looks anything up.
+ */
+static wbuf_entry_t *_wbuf_find(machine_t *m, uword_t line) {
+    for (unsigned i = 0; i < m->wbuf_size; i++) {
+        if (m->wbuf[i].busy && m->wbuf[i].line == line)
+            return &m->wbuf[i];
+    }
+    return NULL;
+}
 
-    for (size_t i = 0; i < width; i++) {
-        //cache miss code
-        if (!check_hit(guest.cache, current_address, READ)) {
-            uword_t block_address = current_address & ~(B-1);
-            // first cycle of a miss, keep track of address and number of cycles
-            if(inflight_addr != block_address || !inflight) {
-                inflight_addr = block_address;
-                inflight_cycles = guest.cache->d;
-                inflight = true;
-            }
+static wbuf_entry_t *_wbuf_alloc(machine_t *m, uword_t line, bool victim, uint64_t ready) {
+    size_t B = m->cache->B;
+
+    for (unsigned i = 0; i < m->wbuf_size; i++) {
+        wbuf_entry_t *e = &m->wbuf[i];
+        if (e->busy)
+            continue;
+        if (!e->bytes)
+            e->bytes = malloc(2 * B);
+        memset(e->bytes + B, victim, B);
+        e->busy = true;
+        e->victim = victim;
+        e->line = line;
+        e->ready = ready;
+        return e;
+    }
+    return NULL;
+}
+
+static void _wbuf_drain(machine_t *m, wbuf_entry_t *e) {
+    if (m->cache->data)
+        _mem_write_block(m, e->line, e->bytes, m->cache->B);
+    e->busy = false;
+}
+
+// Write a line evicted from the data cache in cycle when back to memory, if it is dirty.
+static void _writeback(machine_t *m, const evicted_line_t *evicted, uint64_t when) {
+    if (!evicted->valid || !evicted->dirty)
+        return;
+    if (m->wbuf_size) {
+        wbuf_entry_t *e = _wbuf_alloc(m, evicted->addr, true, when + m->cache->d - 1);
+        if (e) {
+            if (evicted->data)
+                memcpy(e->bytes, evicted->data, m->cache->B);
+            m->wbuf_victims++;
+            return;
+        }
+    }
+    if (evicted->data)
+        _mem_write_block(m, evicted->addr, evicted->data, m->cache->B);
+}
+
+/*
+ * The levels below the L1 caches (-L) are tag-only: memory always holds the
+ * data, since the L1 data cache writes back to it, so they decide only how
+ * long a miss takes. A miss in an L1 cache looks its line up in each outer
+ * level in turn, adding that level's d, until one hits; a line no level holds
+ * adds the latency of memory as well: the L1 data cache's d, or whatever the
+ * DRAM model (-D) makes of a request reaching it that cycle. The outer levels
+ * are updated when the miss starts, the L1 cache when the line arrives.
+ */
+
+// Drop the lines of block [addr, addr+len) from every level above level.
+static void _back_invalidate(machine_t *m, unsigned level, uword_t addr, size_t len) {
+    cache_t *upper[MAX_OUTER + 2] = {m->cache, m->icache};
+    unsigned n = 2;
+    evicted_line_t evicted;
+
+    for (unsigned i = 0; i < level; i++)
+        upper[n++] = m->outer[i];
+    for (unsigned i = 0; i < n; i++) {
+        cache_t *c = upper[i];
+        if (!c)
+            continue;
+        for (uword_t a = addr & ~(uword_t) (c->B - 1); a < addr + len; a += c->B) {
+            if (invalidate_line(c, a, &evicted) && c == m->cache)
+                _writeback(m, &evicted, m->num_instr);
+        }
+    }
+}
 
-            // decrement cycles to wait and return if > 0
-            inflight_cycles--;
-            if(inflight_cycles > 0) {
-                dmem_status = IN_FLIGHT;
-                return 0;
+// Bring line into outer level level, keeping an inclusive hierarchy inclusive.
+static void _outer_fill(machine_t *m, unsigned level, uword_t line) {
+    cache_t *c = m->outer[level];
+    evicted_line_t evicted;
+
+    replace_line(c, line, READ, &evicted);
+    if (m->inclusion == INCLUSIVE && evicted.valid)
+        _back_invalidate(m, level, evicted.addr, c->B);
+}
+
+// Number of cycles until a line that missed in an L1 cache arrives.
+static uint64_t _miss_latency(machine_t *m, uword_t line) {
+    uint64_t latency = 0;
+    unsigned level;
+    evicted_line_t evicted;
+
+    for (level = 0; level < m->num_outer; level++) {
+        latency += m->outer[level]->d;
+        if (check_hit(m->outer[level], line, READ))
+            break;
+    }
+    if (level == m->num_outer)
+        latency += m->dram ? dram_access(m->dram, line, m->num_instr + latency) : (uint64_t) m->cache->d;
+
+    // An exclusive level gives the line up to the L1 cache; the others keep
+    // a copy in every level it missed in.
+    if (m->inclusion == EXCLUSIVE) {
+        if (level < m->num_outer)
+            invalidate_line(m->outer[level], line, &evicted);
+    } else {
+        for (unsigned i = 0; i < level; i++)
+            _outer_fill(m, i, line);
+    }
+    return latency;
+}
+
+// Hand a line evicted from an L1 cache to the outer levels.
+static void _l1_victim(machine_t *m, const evicted_line_t *evicted) {
+    if (!evicted->valid || m->num_outer == 0)
+        return;
+    if (m->inclusion != EXCLUSIVE) {
+        // a write-back updates the L2's copy, if it has one
+        cache_line_t *line = get_line(m->outer[0], evicted->addr);
+        if (line && evicted->dirty)
+            line->dirty = true;
+        return;
+    }
+    // An exclusive L2 takes the victim, and its own victim goes to the L3.
+    evicted_line_t victim = *evicted, next;
+    for (unsigned i = 0; i < m->num_outer && victim.valid; i++) {
+        cache_line_t *line = get_line(m->outer[i], victim.addr);
+        if (line) {
+            line->dirty |= victim.dirty;
+            return;
+        }
+        replace_line(m->outer[i], victim.addr, victim.dirty ? WRITE : READ, &next);
+        victim = next;
+    }
+}
+
+bool mem_ifetch(machine_t *m, const uint64_t addr) {
+    if (!m->icache)
+        return true;
+    uword_t line = addr & ~(uword_t) (m->icache->B - 1);
+
+    // Fetch reads a line once for all the instructions in it.
+    if (line != m->ifetch_line) {
+        m->ifetch_line = line;
+        m->ifetch_ready = m->num_instr;
+        if (!check_hit(m->icache, line, READ)) {
+            evicted_line_t evicted;
+            m->ifetch_ready += _miss_latency(m, line) - 1;
+            replace_line(m->icache, line, READ, &evicted);
+            _l1_victim(m, &evicted);
+        }
+    }
+    return m->num_instr >= m->ifetch_ready;
+}
+
+/*
+ * A prefetcher (-p) is told about every line a demand access looks up and
+ * names lines to fetch ahead of use. Each prefetch takes as long as a miss to
+ * its line would and waits in the prefetch queue until then; the lines due
+ * are filled, oldest first, before an access looks up anything, as with the
+ * MSHRs. A demand miss on a queued line takes the prefetch over and waits
+ * only for the rest of it: a late prefetch. A prefetched line is useful if a
+ * demand access hits it and polluting if it is evicted before any does.
+ */
+static prefetch_entry_t *_prefetch_find(prefetcher_t *pf, uword_t line) {
+    for (unsigned i = 0; i < pf->queued; i++) {
+        if (pf->queue[i].line == line)
+            return &pf->queue[i];
+    }
+    return NULL;
+}
+
+static void _prefetch_remove(prefetcher_t *pf, prefetch_entry_t *entry) {
+    memmove(entry, entry + 1, (pf->queue + --pf->queued - entry) * sizeof(*entry));
+}
+
+static void _prefetch_fill(machine_t *m, uword_t line, uint64_t when) {
+    size_t B = m->cache->B;
+    evicted_line_t evicted;
+
+    replace_line(m->cache, line, READ, &evicted)->prefetched = true;
+    if (evicted.prefetched)
+        m->prefetcher->polluting++;
+    _l1_victim(m, &evicted);
+    _writeback(m, &evicted, when);
+    if (evicted.data)
+        _mem_read_block(m, line, evicted.data, B);
+}
+
+static void _prefetch_retire(machine_t *m, uint64_t now) {
+    prefetcher_t *pf = m->prefetcher;
+
+    for (;;) {
+        prefetch_entry_t *oldest = NULL;
+        for (unsigned i = 0; i < pf->queued; i++) {
+            if (pf->queue[i].ready <= now && (!oldest || pf->queue[i].ready < oldest->ready))
+                oldest = &pf->queue[i];
+        }
+        if (!oldest)
+            return;
+        prefetch_entry_t entry = *oldest;
+        _prefetch_remove(pf, oldest);
+        _prefetch_fill(m, entry.line, entry.ready);
+    }
+}
+
+static mshr_t *_mshr_find(machine_t *m, uword_t line);
+
+// Send a prefetch for line, unless it is already in the cache or on its way.
+static void _prefetch_issue(machine_t *m, uword_t line) {
+    prefetcher_t *pf = m->prefetcher;
+    uint64_t now = m->num_instr;
+
+    if (line < m->mem->seg_start_addr[DATA_SEG] || line >= m->mem->seg_start_addr[KERNEL_SEG]
+        || get_line(m->cache, line) || _prefetch_find(pf, line) || (m->inflight && m->inflight_addr == line)
+        || _mshr_find(m, line) || _wbuf_find(m, line))
+        return;
+    if (pf->queued == PREFETCH_QUEUE) {
+        pf->dropped++;
+        return;
+    }
+    pf->issued++;
+    uint64_t ready = now + _miss_latency(m, line) - 1;
+    if (ready <= now) {
+        _prefetch_fill(m, line, now);
+        return;
+    }
+    pf->queue[pf->queued++] = (prefetch_entry_t) {line, ready};
+}
+
+// Tell the prefetcher about a demand lookup of line, at addr, that hit or not.
+static void _prefetch_train(machine_t *m, uword_t addr, uword_t line, bool hit) {
+    prefetcher_t *pf = m->prefetcher;
+    uint64_t lines[MAX_PREFETCH_DEGREE];
+    bool trigger = !hit;
+
+    if (hit) {
+        cache_line_t *cl = get_line(m->cache, line);
+        if (cl->prefetched) {
+            cl->prefetched = false;
+            pf->useful++;
+            trigger = true;
+        }
+    }
+    unsigned n = pf->ops->train(pf, m->dmem_PC, addr > line ? addr : line, trigger, lines);
+    for (unsigned i = 0; i < n; i++)
+        _prefetch_issue(m, lines[i]);
+}
+
+// The cycle in which a line that just missed arrives, taking over its prefetch
+// or its writeback if it has one.
+static uint64_t _demand_ready(machine_t *m, uword_t line) {
+    prefetch_entry_t *entry;
+    wbuf_entry_t *e;
+    uint64_t now = m->num_instr;
+
+    if (m->wbuf_size && (e = _wbuf_find(m, line)) && e->victim) {
+        m->wbuf_forwards++;
+        _wbuf_drain(m, e);
+        return now;
+    }
+    if (m->prefetcher && (entry = _prefetch_find(m->prefetcher, line))) {
+        uint64_t ready = entry->ready;
+        m->prefetcher->late++;
+        _prefetch_remove(m->prefetcher, entry);
+        return ready;
+    }
+    return now + _miss_latency(m, line) - 1;
+}
+
+// Fill the line a write buffer entry's stores missed on, then apply them.
+static void _wbuf_fill(machine_t *m, wbuf_entry_t *e) {
+    size_t B = m->cache->B;
+    evicted_line_t evicted;
+
+    replace_line(m->cache, e->line, WRITE, &evicted);
+    _l1_victim(m, &evicted);
+    _writeback(m, &evicted, e->ready);
+    if (evicted.data) {
+        _mem_read_block(m, e->line, evicted.data, B);
+        for (size_t i = 0; i < B; i++) {
+            if (e->bytes[B + i])
+                evicted.data[i] = e->bytes[i];
+        }
+    }
+    e->busy = false;
+}
+
+static void _wbuf_retire(machine_t *m, uint64_t now) {
+    for (;;) {
+        wbuf_entry_t *oldest = NULL;
+        for (unsigned i = 0; i < m->wbuf_size; i++) {
+            wbuf_entry_t *e = &m->wbuf[i];
+            if (e->busy && e->ready <= now && (!oldest || e->ready < oldest->ready))
+                oldest = e;
+        }
+        if (!oldest)
+            return;
+        if (oldest->victim)
+            _wbuf_drain(m, oldest);
+        else
+            _wbuf_fill(m, oldest);
+    }
+}
+
+/*
+ * Start a miss on line in a blocking cache. Returns false if the write buffer
+ * lets the access go on without the line, and otherwise sets *ready to the
+ * cycle in which the line will be in the cache.
+ */
+static bool _blocking_miss(machine_t *m, uword_t addr, unsigned width, uword_t line, operation_t op, uint64_t *ready) {
+    size_t B = m->cache->B;
+    wbuf_entry_t *e = m->wbuf_size ? _wbuf_find(m, line) : NULL;
+    uint64_t now = m->num_instr;
+
+    if (e && !e->victim) {
+        bool covered = true;
+        for (uword_t a = addr > line ? addr : line; a < addr + width && a < line + B; a++)
+            covered &= e->bytes[B + (a - line)];
+        if (op == WRITE || covered) {
+            m->wbuf_forwards += op == READ;
+            return false;
+        }
+        // The load has to wait for the line. Fill it now: nothing else can
+        // look at the cache until then.
+        *ready = e->ready > now ? e->ready : now;
+        _wbuf_fill(m, e);
+        return true;
+    }
+    *ready = _demand_ready(m, line);
+    if (op == WRITE && m->wbuf_size) {
+        if (_wbuf_alloc(m, line, false, *ready)) {
+            m->wbuf_stores++;
+            return false;
+        }
+        m->wbuf_full++;
+    }
+    return true;
+}
+
+/*
+ * Look up the lines an access of width bytes at addr touches: one, or two if
+ * it straddles a line boundary. Each line counts once as a hit or a miss, when
+ * the access first reaches it. A missing line keeps the memory stage waiting
+ * for d cycles, during which the access is retried every cycle; a retry picks
+ * up where the access stopped and counts nothing. Returns true once every line
+ * is in the cache.
+ */
+static bool _mem_access_cache(machine_t *m, const uint64_t addr, const unsigned width, operation_t op) {
+    size_t B = m->cache->B;
+    uword_t first = addr & ~(B-1), last = (addr + width - 1) & ~(B-1);
+    uword_t line = first;
+
+    if (m->prefetcher)
+        _prefetch_retire(m, m->num_instr);
+    if (m->wbuf_size)
+        _wbuf_retire(m, m->num_instr);
+    // a retry resumes at the line being waited on
+    if (m->inflight && m->inflight_addr >= first && m->inflight_addr <= last)
+        line = m->inflight_addr;
+
+    for (; line <= last; line += B) {
+        if (!m->inflight || m->inflight_addr != line) {
+            bool hit = check_hit(m->cache, line, op);
+            uint64_t ready;
+            bool wait = !hit && _blocking_miss(m, addr, width, line, op, &ready);
+            if (wait) {
+                // first cycle of a miss, keep track of address and number of cycles
+                m->inflight_addr = line;
+                m->inflight_cycles = ready - m->num_instr + 1;
+                m->inflight = true;
             }
+            if (m->prefetcher)
+                _prefetch_train(m, addr, line, hit);
+            if (!wait)
+                continue;
+        }
+
+        // decrement cycles to wait and return if > 0
+        m->inflight_cycles--;
+        if (m->inflight_cycles > 0) {
+            m->dmem_status = IN_FLIGHT;
+            return false;
+        }
+
+        // cache delay is now finished
+        m->inflight = false;
+        // (unless the write buffer has already filled the line)
+        if (m->wbuf_size && get_line(m->cache, line))
+            continue;
+        // replace a line, writing it back to memory if it is valid and dirty
+        evicted_line_t evicted;
+        replace_line(m->cache, line, op, &evicted);
+        _l1_victim(m, &evicted);
+        _writeback(m, &evicted, m->num_instr);
+        // then fill it in place with the data from memory
+        // (a tag-only cache holds no data, so there is nothing to move)
+        if (evicted.data)
+            _mem_read_block(m, line, evicted.data, B);
+    }
+    return true;
+}
+
+/*
+ * A non-blocking cache (-m) keeps up to num_mshrs misses outstanding, each in
+ * an MSHR that fills its line in the cycle it arrives. A store that misses
+ * merges its bytes into the line's MSHR, allocating one if there is none, and
+ * completes at once. A load that misses waits for its line, so it overlaps
+ * with the store misses before it and later hits proceed under those. A miss
+ * that finds every MSHR busy waits for the first one to retire. The MSHRs due
+ * by the current cycle are retired, oldest first, before an access looks up
+ * anything, which fills their lines in the same order as doing it each cycle.
+ */
+static mshr_t *_mshr_find(machine_t *m, uword_t line) {
+    for (unsigned i = 0; i < m->num_mshrs; i++) {
+        if (m->mshrs[i].busy && m->mshrs[i].line == line)
+            return &m->mshrs[i];
+    }
+    return NULL;
+}
+
+static void _mshr_fill(machine_t *m, mshr_t *mshr) {
+    size_t B = m->cache->B;
+    evicted_line_t evicted;
+
+    replace_line(m->cache, mshr->line, mshr->write ? WRITE : READ, &evicted);
+    _l1_victim(m, &evicted);
+    _writeback(m, &evicted, mshr->ready);
+    if (evicted.data) {
+        _mem_read_block(m, mshr->line, evicted.data, B);
+        // then apply the stores that were waiting on the line
+        for (size_t i = 0; i < B; i++) {
+            if (mshr->pending[B + i])
+                evicted.data[i] = mshr->pending[i];
+        }
+    }
+    mshr->busy = false;
+}
 
-            // cache delay is now finished
-            inflight = false;
-            // get data from memory to store in the cache
-            uint8_t *block = calloc(B, 1);
-            for (int j = 0; j < B; j++) {
-                uint64_t addr_j = (addr & ~(B-1)) + j;
-                block[j] = (uint8_t)_mem_read_LE(addr_j, 1);
+static void _mshr_retire(machine_t *m, uint64_t now) {
+    for (;;) {
+        mshr_t *oldest = NULL;
+        for (unsigned i = 0; i < m->num_mshrs; i++) {
+            mshr_t *mshr = &m->mshrs[i];
+            if (mshr->busy && mshr->ready <= now && (!oldest || mshr->ready < oldest->ready))
+                oldest = mshr;
+        }
+        if (!oldest)
+            return;
+        _mshr_fill(m, oldest);
+    }
+}
+
+// Stall the memory stage until cycle ready, remembering how far the access got.
+static bool _mshr_wait(machine_t *m, uword_t line, uint64_t ready) {
+    m->inflight = true;
+    m->inflight_addr = line;
+    m->inflight_cycles = ready - m->num_instr;
+    m->dmem_status = IN_FLIGHT;
+    return false;
+}
+
+/*
+ * _mem_access_cache for a non-blocking cache. Returns true once every line
+ * the access touches is in the cache, or, for a store, is in the cache or in
+ * an MSHR. As before, each line counts as a hit or a miss only once.
+ */
+static bool _mem_access_mshr(machine_t *m, const uint64_t addr, const unsigned width, operation_t op) {
+    size_t B = m->cache->B;
+    uword_t first = addr & ~(B-1), last = (addr + width - 1) & ~(B-1);
+    uint64_t now = m->num_instr;
+    // a retry has already looked up the lines up to the one it waited on
+    bool retry = m->inflight && m->inflight_addr >= first && m->inflight_addr <= last;
+
+    _mshr_retire(m, now);
+    if (m->prefetcher)
+        _prefetch_retire(m, now);
+    if (m->wbuf_size)
+        _wbuf_retire(m, now);
+    for (uword_t line = first; line <= last; line += B) {
+        bool counted = retry && line <= m->inflight_addr;
+        if (counted) {
+            if (get_line(m->cache, line))
+                continue;
+        } else {
+            bool hit = check_hit(m->cache, line, op);
+            if (m->prefetcher)
+                _prefetch_train(m, addr, line, hit);
+            if (hit)
+                continue;
+        }
+
+        mshr_t *mshr = _mshr_find(m, line);
+        if (mshr) {
+            if (!counted)
+                m->mshr_merges++;
+        } else {
+            for (unsigned i = 0; i < m->num_mshrs && !mshr; i++) {
+                if (!m->mshrs[i].busy)
+                    mshr = &m->mshrs[i];
             }
-            // hopefully they properly implemented writing incoming data to the cache
-            evicted_line_t *evicted = handle_miss(guest.cache, block_address, READ, block);
-            data = *((uint64_t *)block + (addr & (B-1)));
-            // if the evicted line is valid and dirty, write changes back to memory
-            if (evicted->valid && evicted->dirty) {
-                for (int j = 0; j < B; j++) {
-                    _mem_write_LE(evicted->addr+j, evicted->data[j], 1);
+            if (!mshr) {
+                uint64_t ready = UINT64_MAX;
+                for (unsigned i = 0; i < m->num_mshrs; i++) {
+                    if (m->mshrs[i].ready < ready)
+                        ready = m->mshrs[i].ready;
                 }
+                if (!counted)
+                    m->mshr_full++;
+                return _mshr_wait(m, line, ready);
+            }
+            if (!mshr->pending)
+                mshr->pending = malloc(2 * B);
+            memset(mshr->pending + B, 0, B);
+            mshr->busy = true;
+            mshr->line = line;
+            mshr->ready = _demand_ready(m, line);
+            mshr->write = false;
+            if (mshr->ready <= now) {
+                _mshr_fill(m, mshr);
+                continue;
             }
-            // free temps
-            free(block);
-            free(evicted->data);
-            free(evicted);
         }
-        current_address++;
+        if (op == READ)
+            return _mshr_wait(m, line, mshr->ready);
     }
-    // actually get data from the cache
-    get_word_cache(guest.cache, addr, &data);
-    dmem_status = READY;
+    m->inflight = false;
+    return true;
+}
+
+// Store width bytes, each into its line in the cache or else into the line's MSHR.
+static void _mshr_store(machine_t *m, const uint64_t addr, const uint64_t data, const unsigned width) {
+    size_t B = m->cache->B;
+
+    for (unsigned i = 0; i < width; i++) {
+        uword_t line = (addr + i) & ~(B-1);
+        size_t offset = (addr + i) & (B-1);
+        uint8_t byte = data >> (8 * i);
+        cache_line_t *cl = get_line(m->cache, line);
+        if (cl) {
+            cl->dirty = true;
+            if (m->cache->data)
+                line_data(m->cache, cl)[offset] = byte;
+        } else {
+            mshr_t *mshr = _mshr_find(m, line);
+            mshr->write = true;
+            mshr->pending[offset] = byte;
+            mshr->pending[B + offset] = 1;
+        }
+    }
+    // a tag-only cache leaves the data in memory
+    if (!m->cache->data)
+        _mem_write_LE(m, addr, data, width);
+}
+
+// Read width bytes at addr from the stores waiting in the write buffer.
+static uint64_t _wbuf_load(machine_t *m, const uint64_t addr, const unsigned width) {
+    size_t B = m->cache->B;
+    wbuf_entry_t *e = _wbuf_find(m, addr & ~(B-1));
+    uint64_t data = 0;
+
+    for (int i = width - 1; i >= 0; i--)
+        data = (data << 8) | e->bytes[(addr + i) & (B-1)];
     return data;
 }
 
-uint64_t _mem_read(const uint64_t addr, const unsigned width) {
+// Merge a store of width bytes at addr into the write buffer's entry for its line.
+static void _wbuf_store(machine_t *m, const uint64_t addr, const uint64_t data, const unsigned width) {
+    size_t B = m->cache->B;
+    wbuf_entry_t *e = _wbuf_find(m, addr & ~(B-1));
+
+    for (unsigned i = 0; i < width; i++) {
+        size_t offset = (addr + i) & (B-1);
+        e->bytes[offset] = data >> (8 * i);
+        e->bytes[B + offset] = 1;
+    }
+}
+
+static uint64_t _mem_read_cache(machine_t *m, const uint64_t addr, const unsigned width) {
+    word_t data = 0;
+
+    if (!(m->num_mshrs ? _mem_access_mshr(m, addr, width, READ) : _mem_access_cache(m, addr, width, READ)))
+        return 0;
+    // actually get data from the cache (or the write buffer, if the load's
+    // bytes are all waiting there), or from memory if the cache holds none
+    if (m->wbuf_size && m->cache->data && !get_line(m->cache, addr))
+        data = _wbuf_load(m, addr, width);
+    else
+        get_word_cache(m->cache, addr, &data);
+    if (!m->cache->data)
+        data = _mem_read_LE(m, addr, width);
+    m->dcache_bytes += width;
+    m->dmem_status = READY;
+    return data;
+}
+
+uint64_t _mem_read(machine_t *m, const uint64_t addr, const unsigned width) {
     if (is_special_addr(addr))
-        return _mem_read_special(addr, width);
+        return _mem_read_special(m, addr, width);
+
+    if (m->sweep && addr >= m->mem->seg_start_addr[DATA_SEG])
+        sweep_access(m, addr, width, READ);
 
     // Use the cache if it exists and this is not an instruction.
-    if (guest.cache && addr >= guest.mem->seg_start_addr[DATA_SEG]) {
-        return _mem_read_cache(addr, width);
+    if (m->cache && addr >= m->mem->seg_start_addr[DATA_SEG]) {
+        return _mem_read_cache(m, addr, width);
     }
 
-    return _mem_read_LE(addr, width);
+    return _mem_read_LE(m, addr, width);
 }
 
-static write_ret_code_t _mem_write_cache(const uint64_t addr, const uint64_t data, const unsigned width) {
-    size_t B = guest.cache->B;
-	uword_t current_address = addr; 
-
-    for (size_t i = 0; i < width; i++) {
-        // cache miss code
-        if (!check_hit(guest.cache, current_address, WRITE)) {
-            // first miss cycle, keep track of addr and number of cycles to wait
-            uword_t block_address = current_address & ~(B-1);
-            if(inflight_addr != block_address || !inflight) {
-                inflight_addr = block_address;
-                inflight_cycles = guest.cache->d;
-                inflight = true;
-            }
-            // wait a cycle until delay is done
-            inflight_cycles--;
-            if(inflight_cycles > 0) {
-                dmem_status = IN_FLIGHT;
-                return WRITE_FAILURE;
-            }
-            // no more delay
-            inflight = false;
-            // get evicted line from cache,
-            // incoming data is NULL here because the students are supposed
-            // to implement the write themselves.
-            uint8_t *block = calloc(B, 1);
-            for (int j = 0; j < B; j++) {
-                uint64_t addr_j = block_address + j;
-                block[j] = (uint8_t)_mem_read_LE(addr_j, 1);
-            }
-            evicted_line_t *evicted = handle_miss(guest.cache, block_address, WRITE, block);
-            // if evicted line is dirty, write changes back to memory
-            if (evicted->valid && evicted->dirty) {
-                for (int j = 0; j < B; j++) {
-                    _mem_write_LE(evicted->addr+j, evicted->data[j], 1);
-                }
-            }
-            // free temps
-            free(evicted->data);
-            free(evicted);
-        }
-        current_address++;
+static write_ret_code_t _mem_write_cache(machine_t *m, const uint64_t addr, const uint64_t data, const unsigned width) {
+    if (m->num_mshrs) {
+        if (!_mem_access_mshr(m, addr, width, WRITE))
+            return WRITE_FAILURE;
+        _mshr_store(m, addr, data, width);
+        m->dcache_bytes += width;
+        m->dmem_status = READY;
+        return WRITE_SUCCESS;
     }
-    // actually write to the cache.
-    set_word_cache(guest.cache, addr, data);
-    dmem_status = READY;
+    if (!_mem_access_cache(m, addr, width, WRITE))
+        return WRITE_FAILURE;
+    // actually write to the cache (or to the write buffer, if the line is
+    // still on its way), or to memory if the cache holds no data.
+    if (m->wbuf_size && !get_line(m->cache, addr))
+        _wbuf_store(m, addr, data, width);
+    else
+        set_word_cache(m->cache, addr, data);
+    if (!m->cache->data)
+        _mem_write_LE(m, addr, data, width);
+    m->dcache_bytes += width;
+    m->dmem_status = READY;
     return WRITE_SUCCESS;
 }
 
-write_ret_code_t _mem_write(const uint64_t addr, const uint64_t data, const unsigned width) {
+write_ret_code_t _mem_write(machine_t *m, const uint64_t addr, const uint64_t data, const unsigned width) {
     if (is_special_addr(addr))
         return _mem_write_special(addr, data, width);
 
+    if (m->sweep && addr >= m->mem->seg_start_addr[DATA_SEG])
+        sweep_access(m, addr, width, WRITE);
+
+    // Self-modifying code: drop any predecoded copies of the bytes written.
+    if (addr < m->mem->seg_start_addr[DATA_SEG])
+        predecode_invalidate(m, addr, width);
+
     // Use the cache if it exists and this is not an instruction.
-    if (guest.cache && addr >= guest.mem->seg_start_addr[DATA_SEG]) {
-        return _mem_write_cache(addr, data, width);
+    if (m->cache && addr >= m->mem->seg_start_addr[DATA_SEG]) {
+        return _mem_write_cache(m, addr, data, width);
     }
 
-    return _mem_write_LE(addr, data, width);
+    return _mem_write_LE(m, addr, data, width);
 }
 
-char      mem_read_B (const uint64_t addr) {return (char)      _mem_read(addr, 1);}
-short     mem_read_S (const uint64_t addr) {return (short)     _mem_read(addr, 2);}
-int       mem_read_I (const uint64_t addr) {return (int)       _mem_read(addr, 4);}
-long      mem_read_L (const uint64_t addr) {return (long)      _mem_read(addr, 8);}
-long long mem_read_LL(const uint64_t addr) {return (long long) _mem_read(addr, 8);}
+char      mem_read_B (machine_t *m, const uint64_t addr) {return (char)      _mem_read(m, addr, 1);}
+short     mem_read_S (machine_t *m, const uint64_t addr) {return (short)     _mem_read(m, addr, 2);}
+int       mem_read_I (machine_t *m, const uint64_t addr) {return (int)       _mem_read(m, addr, 4);}
+long      mem_read_L (machine_t *m, const uint64_t addr) {return (long)      _mem_read(m, addr, 8);}
+long long mem_read_LL(machine_t *m, const uint64_t addr) {return (long long) _mem_read(m, addr, 8);}
 
-write_ret_code_t mem_write_B (const uint64_t addr, const char      data) {return _mem_write(addr, (uint64_t) data, 1);}
-write_ret_code_t mem_write_S (const uint64_t addr, const short     data) {return _mem_write(addr, (uint64_t) data, 2);}
-write_ret_code_t mem_write_I (const uint64_t addr, const int       data) {return _mem_write(addr, (uint64_t) data, 4);}
-write_ret_code_t mem_write_L (const uint64_t addr, const long      data) {return _mem_write(addr, (uint64_t) data, 8);}
-write_ret_code_t mem_write_LL(const uint64_t addr, const long long data) {return _mem_write(addr, (uint64_t) data, 8);}
+write_ret_code_t mem_write_B (machine_t *m, const uint64_t addr, const char      data) {return _mem_write(m, addr, (uint64_t) data, 1);}
+write_ret_code_t mem_write_S (machine_t *m, const uint64_t addr, const short     data) {return _mem_write(m, addr, (uint64_t) data, 2);}
+write_ret_code_t mem_write_I (machine_t *m, const uint64_t addr, const int       data) {return _mem_write(m, addr, (uint64_t) data, 4);}
+write_ret_code_t mem_write_L (machine_t *m, const uint64_t addr, const long      data) {return _mem_write(m, addr, (uint64_t) data, 8);}
+write_ret_code_t mem_write_LL(machine_t *m, const uint64_t addr, const long long data) {return _mem_write(m, addr, (uint64_t) data, 8);}
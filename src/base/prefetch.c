@@ -0,0 +1,177 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * prefetch.c - Detectors for the data cache's hardware prefetchers.
+ *
+ * Each detector only decides which lines to ask for; mem.c sends the
+ * requests, fills the lines when they arrive and keeps the statistics.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+
+// Entries in the stride detector's table, indexed by PC.
+#define STRIDE_ENTRIES 64
+// Streams tracked at once, and how many lines away a miss may be to extend one.
+#define STREAM_ENTRIES 16
+#define STREAM_WINDOW 16
+
+typedef struct stride_entry {
+    uint64_t pc;
+    uint64_t last;          // Address of the instruction's last access
+    int64_t stride;
+    unsigned confidence;    // Times in a row the stride has repeated, up to 3
+} stride_entry_t;
+
+typedef struct stream_entry {
+    bool valid;
+    uint64_t last;          // Line number of the stream's last miss
+    int dir;                // 1 ascending, -1 descending, 0 not known yet
+    unsigned confidence;    // Misses in a row in that direction, up to 3
+    uint64_t used;          // When it was last extended, to pick one to replace
+} stream_entry_t;
+
+typedef struct stream_table {
+    stream_entry_t streams[STREAM_ENTRIES];
+    uint64_t clock;
+} stream_table_t;
+
+static unsigned none_train(prefetcher_t *pf, uint64_t pc, uint64_t addr, bool trigger, uint64_t *lines) {
+    return 0;
+}
+
+// The degree lines after one that missed, or after the first use of a prefetched one.
+static unsigned next_line_train(prefetcher_t *pf, uint64_t pc, uint64_t addr, bool trigger, uint64_t *lines) {
+    uint64_t line = addr >> pf->b;
+
+    if (!trigger)
+        return 0;
+    for (unsigned k = 1; k <= pf->degree; k++)
+        lines[k - 1] = (line + k) << pf->b;
+    return pf->degree;
+}
+
+/*
+ * Once an instruction has moved by the same stride twice in a row, the next
+ * degree lines along that stride. Strides shorter than a line step a line at
+ * a time. Every access trains the detector, not only misses.
+ */
+static unsigned stride_train(prefetcher_t *pf, uint64_t pc, uint64_t addr, bool trigger, uint64_t *lines) {
+    stride_entry_t *e = &((stride_entry_t *) pf->table)[(pc >> 2) % STRIDE_ENTRIES];
+    int64_t stride = addr - e->last;
+    int64_t B = 1 << pf->b;
+
+    if (e->pc != pc) {
+        e->pc = pc;
+        e->last = addr;
+        e->stride = 0;
+        e->confidence = 0;
+        return 0;
+    }
+    e->last = addr;
+    if (stride == 0)
+        return 0;
+    if (stride == e->stride) {
+        if (e->confidence < 3)
+            e->confidence++;
+    } else {
+        e->stride = stride;
+        e->confidence = 0;
+    }
+    if (e->confidence == 0)
+        return 0;
+
+    if (stride > -B && stride < B)
+        stride = stride > 0 ? B : -B;
+    for (unsigned k = 1; k <= pf->degree; k++)
+        lines[k - 1] = (addr + k * stride) >> pf->b << pf->b;
+    return pf->degree;
+}
+
+/*
+ * Misses within STREAM_WINDOW lines of each other extend one stream. Once
+ * two of them in a row have gone the same way, each further miss (or first
+ * use of a prefetched line) in the stream asks for the degree lines beyond it.
+ */
+static unsigned stream_train(prefetcher_t *pf, uint64_t pc, uint64_t addr, bool trigger, uint64_t *lines) {
+    stream_table_t *t = pf->table;
+    uint64_t line = addr >> pf->b;
+    stream_entry_t *e, *victim = &t->streams[0];
+
+    if (!trigger)
+        return 0;
+    t->clock++;
+    for (e = t->streams; e < t->streams + STREAM_ENTRIES; e++) {
+        int64_t delta = line - e->last;
+        if (e->valid && delta != 0 && delta >= -STREAM_WINDOW && delta <= STREAM_WINDOW)
+            break;
+        if (!e->valid || (victim->valid && e->used < victim->used))
+            victim = e;
+    }
+    if (e == t->streams + STREAM_ENTRIES) {
+        victim->valid = true;
+        victim->last = line;
+        victim->dir = 0;
+        victim->confidence = 0;
+        victim->used = t->clock;
+        return 0;
+    }
+
+    int dir = line > e->last ? 1 : -1;
+    if (dir == e->dir || e->dir == 0) {
+        if (e->confidence < 3)
+            e->confidence++;
+    } else {
+        e->confidence = 1;
+    }
+    e->dir = dir;
+    e->last = line;
+    e->used = t->clock;
+    if (e->confidence < 2)
+        return 0;
+    for (unsigned k = 1; k <= pf->degree; k++)
+        lines[k - 1] = (line + dir * (int64_t) k) << pf->b;
+    return pf->degree;
+}
+
+static const prefetch_ops_t prefetch_ops[NUM_PREFETCH] = {
+    [PREFETCH_NONE]      = {"none",      0,                                       none_train},
+    [PREFETCH_NEXT_LINE] = {"next-line", 0,                                       next_line_train},
+    [PREFETCH_STRIDE]    = {"stride",    STRIDE_ENTRIES * sizeof(stride_entry_t), stride_train},
+    [PREFETCH_STREAM]    = {"stream",    sizeof(stream_table_t),                  stream_train},
+};
+
+bool parse_prefetcher(const char *name, prefetch_kind_t *kind) {
+    for (int i = 0; i < NUM_PREFETCH; i++) {
+        if (!strcmp(name, prefetch_ops[i].name)) {
+            *kind = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *prefetcher_name(prefetch_kind_t kind) {
+    return prefetch_ops[kind].name;
+}
+
+prefetcher_t *create_prefetcher(prefetch_kind_t kind, unsigned degree, unsigned B) {
+    prefetcher_t *pf = calloc(1, sizeof(prefetcher_t));
+
+    pf->kind = kind;
+    pf->ops = &prefetch_ops[kind];
+    pf->degree = degree;
+    pf->b = __builtin_ctz(B);
+    pf->table = pf->ops->table_size ? calloc(1, pf->ops->table_size) : NULL;
+    return pf;
+}
+
+void free_prefetcher(prefetcher_t *pf) {
+    free(pf->table);
+    free(pf);
+}
@@ -15,6 +15,9 @@
 #include "hw_elts.h"
 #include "hazard_control.h"
 #include "forward.h"
+#include "interp.h"
+#include "dbt.h"
+#include "sweep.h"
 #include <unistd.h>
 
 #include <pthread.h>
@@ -28,10 +31,35 @@ pthread_barrier_t cycle_end;
 extern uint32_t bitfield_u32(int32_t src, unsigned frompos, unsigned width);
 extern int64_t bitfield_s64(int32_t src, unsigned frompos, unsigned width);
 
-extern machine_t guest;
-extern mem_status_t dmem_status;
 
-void* start_fetch(void* unused) {
+/*
+ * While a data-cache miss is in flight, F, D, X and M stall and W bubbles.
+ * Once W has drained, every further cycle is identical to the one before it:
+ * the memory stage only retries the access, which touches no cache state. If
+ * the cycle that just ended was such a cycle, jump straight to the cycle in
+ * which the miss completes.
+ */
+static void skip_stall_cycles(bool *was_stalled, int hits_before, int misses_before) {
+    cache_t *cache = cur_guest->cache;
+    bool stalled = cache && cur_guest->dmem_status == IN_FLIGHT
+        && F_instr->ctl == P_STALL && D_instr->ctl == P_STALL
+        && X_instr->ctl == P_STALL && M_instr->ctl == P_STALL
+        && W_instr->ctl == P_BUBBLE;
+
+    // Cycles that print, touch cache lines, or halt are simulated one by one.
+    if (stalled && *was_stalled && debug_level == 0 && F_in->status != STAT_HLT
+        && cache->hit_count == hits_before && cache->miss_count == misses_before) {
+        uint64_t skip = cur_guest->inflight_cycles - 1;
+        if (skip > cur_guest->cycle_max - cur_guest->num_instr)
+            skip = cur_guest->cycle_max - cur_guest->num_instr;
+        cur_guest->inflight_cycles -= skip;
+        cur_guest->num_instr += skip;
+    }
+    *was_stalled = stalled;
+}
+
+void* start_fetch(void* machine) {
+    cur_guest = machine;
     pthread_barrier_wait(&cycle_start);
     do {
         fetch_instr(F_out, D_in);
@@ -41,7 +69,8 @@ void* start_fetch(void* unused) {
     pthread_exit(NULL);
 }
 
-void* start_decode(void* unused) { 
+void* start_decode(void* machine) {
+    cur_guest = machine;
     pthread_barrier_wait(&cycle_start); //Guarded do :)
     do {
         decode_instr(D_out, X_in);
@@ -52,7 +81,8 @@ void* start_decode(void* unused) {
     pthread_exit(NULL);
 }
 
-void* start_execute(void* unused) {
+void* start_execute(void* machine) {
+    cur_guest = machine;
     pthread_barrier_wait(&cycle_start);
     do {
         execute_instr(X_out, M_in);   
@@ -62,7 +92,8 @@ void* start_execute(void* unused) {
     pthread_exit(NULL);
 }
 
-void* start_memory(void* unused) {
+void* start_memory(void* machine) {
+    cur_guest = machine;
     pthread_barrier_wait(&cycle_start);
     do {
         memory_instr(M_out, W_in);
@@ -72,7 +103,8 @@ void* start_memory(void* unused) {
     pthread_exit(NULL);
 }
 
-void* start_writeback(void* unused) {
+void* start_writeback(void* machine) {
+    cur_guest = machine;
     pthread_barrier_wait(&cycle_start);
     do {
         wback_instr(W_out);
@@ -82,12 +114,13 @@ void* start_writeback(void* unused) {
     pthread_exit(NULL);
 }
 
-int runElf(const uint64_t entry) {
+int runElf(machine_t *m, const uint64_t entry) {
+    cur_guest = m;
     logging(LOG_INFO, "Running ELF executable");
-    guest.proc->PC = entry;
-    guest.proc->SP = guest.mem->seg_start_addr[STACK_SEG]-8;
-    guest.proc->NZCV = PACK_CC(0, 1, 0, 0);
-    guest.proc->GPR[30] = RET_FROM_MAIN_ADDR;
+    cur_guest->proc->PC = entry;
+    cur_guest->proc->SP = cur_guest->mem->seg_start_addr[STACK_SEG]-8;
+    cur_guest->proc->NZCV = PACK_CC(0, 1, 0, 0);
+    cur_guest->proc->GPR[30] = RET_FROM_MAIN_ADDR;
 
     pipe_reg_t **pipes[] = {&F_instr, &D_instr, &X_instr, &M_instr, &W_instr};
 
@@ -101,12 +134,36 @@ int runElf(const uint64_t entry) {
         (*pipes[i])->ctl = P_BUBBLE;
     }
 
+    cur_guest->num_instr = 0;
+
+    if (cur_guest->exec_mode != EXEC_PIPE) {
+        /* Run the whole program functionally; the pipeline only has to retire
+         * the instruction it stopped at (normally the return from main). */
+        char printbuf[BUF_LEN];
+        if (cur_guest->cache) {
+            logging(LOG_INFO, "The cache is not modeled in functional execution modes");
+            cur_guest->cache = NULL;
+            cur_guest->icache = NULL;
+            cur_guest->num_outer = 0;
+        }
+        cur_guest->num_instr = (cur_guest->exec_mode == EXEC_DBT) ? dbt_run(cur_guest->cycle_max) : fast_forward(cur_guest->cycle_max);
+        sprintf(printbuf, "Executed %ld instructions functionally", cur_guest->num_instr);
+        logging(LOG_INFO, printbuf);
+        if (cur_guest->num_instr >= cur_guest->cycle_max) {
+            cur_guest->proc->status = STAT_AOK;
+            return EXIT_SUCCESS;
+        }
+    } else if (cur_guest->ffwd_max > 0) {
+        /* Skip ahead functionally; the pipeline starts from the resulting state */
+        char printbuf[BUF_LEN];
+        sprintf(printbuf, "Fast-forwarded %ld instructions", fast_forward(cur_guest->ffwd_max));
+        logging(LOG_INFO, printbuf);
+    }
+
     /* Will be selected as the first PC */
-    F_out->pred_PC = guest.proc->PC;
+    F_out->pred_PC = cur_guest->proc->PC;
     F_out->status = STAT_AOK;
-    dmem_status = READY;
-
-    num_instr = 0;
+    cur_guest->dmem_status = READY;
 
 #ifdef PARALLEL
     pthread_t stage_threads[5];
@@ -120,11 +177,19 @@ int runElf(const uint64_t entry) {
     pthread_barrier_init(&latch_end, NULL, 2);
 
     for(int stage = 0; stage < 5; stage++) {
-        pthread_create(stage_threads + stage, NULL, stages[stage], NULL);
+        pthread_create(stage_threads + stage, NULL, stages[stage], cur_guest);
     }
 #endif
 
+    bool was_stalled = false;
+
+    if (cur_guest->exec_mode == EXEC_PIPE)
+        sweep_start(cur_guest);
+
     do {        
+        int hits_before = cur_guest->cache ? cur_guest->cache->hit_count : 0;
+        int misses_before = cur_guest->cache ? cur_guest->cache->miss_count : 0;
+
         /* Run each stage (in reverse order, to get the correct effect) */
         /* TODO: rewrite as independent threads */
 #ifndef PARALLEL
@@ -144,10 +209,10 @@ int runElf(const uint64_t entry) {
 
         // Latch
 
-        F_in->pred_PC = guest.proc->PC;
+        F_in->pred_PC = cur_guest->proc->PC;
 
         /* Set machine state to either continue executing or shutdown */
-        guest.proc->status = W_out->status;
+        cur_guest->proc->status = W_out->status;
 
         uint8_t D_src1 = (D_out->op == OP_MOVZ) ? 0x1F : bitfield_u32(D_out->insnbits, 5, 5);
         uint8_t D_src2 = (D_out->op != OP_STUR) ? bitfield_u32(D_out->insnbits, 16, 5) : bitfield_u32(D_out->insnbits, 0, 5);
@@ -158,7 +223,7 @@ int runElf(const uint64_t entry) {
 
         /* Print debug output */
         if(debug_level > 0)
-            printf("\nPipeline state at end of cycle %ld:\n", num_instr);
+            printf("\nPipeline state at end of cycle %ld:\n", cur_guest->num_instr);
 
 
         show_instr(S_FETCH, debug_level);
@@ -177,7 +242,7 @@ int runElf(const uint64_t entry) {
                     memcpy(pipe->out.generic, pipe->in.generic, pipe->size);
                     break;
                 case P_ERROR:  // Error, bubble this stage
-                    guest.proc->status = STAT_HLT;
+                    cur_guest->proc->status = STAT_HLT;
                 case P_BUBBLE: // Hazard, needs to bubble
                     memset(pipe->out.generic, 0, pipe->size);
                     break;
@@ -186,12 +251,17 @@ int runElf(const uint64_t entry) {
             }
         }
 
-        num_instr++;
-    } while ((guest.proc->status == STAT_AOK || guest.proc->status == STAT_BUB)
-             && num_instr < cycle_max);
+        cur_guest->num_instr++;
+
+        skip_stall_cycles(&was_stalled, hits_before, misses_before);
+    } while ((cur_guest->proc->status == STAT_AOK || cur_guest->proc->status == STAT_BUB)
+             && cur_guest->num_instr < cur_guest->cycle_max);
 
     running_sim = false;
 
+    if (cur_guest->sweep)
+        sweep_finish(cur_guest);
+
 #ifdef PARALLEL
     // Start threads to send end 'signal' (could also just use pthread_kill...)
     pthread_barrier_wait(&cycle_start);
@@ -16,40 +16,88 @@
  **************************************************************************/ 
 
 #include <stdlib.h>
+#include <string.h>
 #include "ptable.h"
 
-#define HASHSIZE 128
-static pte_ptr_t ptable[HASHSIZE];
+const char zero_page[PAGESIZE];
 
-static unsigned long ptable_hash(const uint64_t pnum) {
-    unsigned long h = 0, high;
-    char *s = (char *) &pnum;
+static uint64_t ptable_hash(const ptable_t *ptable, const uint64_t pnum) {
+    // Fibonacci hashing: the top bits of the product index the table.
+    return (pnum * 0x9E3779B97F4A7C15ULL) >> (64 - __builtin_ctzll(ptable->size));
+}
 
-    for (int i = 0; i < 7; i++) {
-        h = (h << 4) + *s++;
-        if ((high = h & 0xF0000000))
-            h ^= high >> 24;
-        h &= ~high;
+pte_ptr_t get_page(ptable_t *ptable, const uint64_t pnum) {
+    if (ptable->size == 0)
+        return NULL;
+    uint64_t mask = ptable->size - 1;
+    pte_ptr_t p;
+    for (uint64_t i = ptable_hash(ptable, pnum); (p = ptable->slots[i]) != NULL; i = (i + 1) & mask) {
+        if (pnum == p->p_num) return p;
     }
-    return h % HASHSIZE;
+    return NULL;
 }
 
-pte_ptr_t get_page(const uint64_t pnum) {
-    unsigned long phash = ptable_hash(pnum);
-    pte_ptr_t p = ptable[phash];
-    for (; p != NULL; p = p->p_next) {
-        if (pnum == p->p_num) return p;
+static void insert_page(ptable_t *ptable, pte_ptr_t page) {
+    uint64_t mask = ptable->size - 1;
+    uint64_t i = ptable_hash(ptable, page->p_num);
+    while (ptable->slots[i] != NULL)
+        i = (i + 1) & mask;
+    ptable->slots[i] = page;
+}
+
+// Double the number of slots (or allocate the first ones) and rehash every page.
+static void grow_ptable(ptable_t *ptable) {
+    pte_ptr_t *old = ptable->slots;
+    uint64_t old_size = ptable->size;
+
+    ptable->size = old_size ? 2 * old_size : PTABLE_INITSIZE;
+    ptable->slots = calloc(ptable->size, sizeof(pte_ptr_t));
+    for (uint64_t i = 0; i < old_size; i++) {
+        if (old[i] != NULL)
+            insert_page(ptable, old[i]);
     }
-    return p;
+    free(old);
 }
 
-pte_ptr_t add_page(const uint64_t num, const uint8_t prot) {
+pte_ptr_t add_shared_page(ptable_t *ptable, const uint64_t num, const uint8_t prot, const char *data) {
     pte_ptr_t npage = malloc(sizeof(pte_t));
     npage->p_num = num;
     npage->p_prot = prot;
+    npage->p_data = (char *) data;
+    npage->p_shared = true;
+    if (2 * (ptable->count + 1) > ptable->size)
+        grow_ptable(ptable);
+    insert_page(ptable, npage);
+    ptable->count++;
+    return npage;
+}
+
+void unshare_page(pte_ptr_t page) {
+    if (page->p_shared) {
+        char *data = malloc(PAGESIZE);
+        memcpy(data, page->p_data, PAGESIZE);
+        page->p_data = data;
+        page->p_shared = false;
+    }
+}
+
+pte_ptr_t add_page(ptable_t *ptable, const uint64_t num, const uint8_t prot) {
+    pte_ptr_t npage = add_shared_page(ptable, num, prot, zero_page);
     npage->p_data = calloc(PAGESIZE,sizeof(char));
-    unsigned long phash = ptable_hash(num);
-    npage->p_next = ptable[phash];
-    ptable[phash] = npage;
+    npage->p_shared = false;
     return npage;
-}
\ No newline at end of file
+}
+
+void free_ptable(ptable_t *ptable) {
+    for (uint64_t i = 0; i < ptable->size; i++) {
+        pte_ptr_t p = ptable->slots[i];
+        if (p != NULL) {
+            if (!p->p_shared)
+                free(p->p_data);
+            free(p);
+        }
+    }
+    free(ptable->slots);
+    ptable->slots = NULL;
+    ptable->size = ptable->count = 0;
+}
@@ -0,0 +1,175 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * sweep.c - Simulate many cache configurations in one run of the pipeline.
+ *
+ * The memory stage's accesses are appended to one of two buffers. When a
+ * buffer fills it is handed to the workers, one per configuration, which
+ * replay it while the pipeline fills the other buffer. A replay does exactly
+ * what _mem_read_cache and _mem_write_cache would have done over the cycles
+ * the access took in that configuration, minus moving any data: every line
+ * the access touches is looked up once, and a missing one stalls for d-1
+ * cycles, or one less than the DRAM model's latency, before it is filled.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "archsim.h"
+#include "sweep.h"
+#include "dram.h"
+
+typedef struct sweep_access {
+    uint64_t addr;
+    uint64_t cycle;         // cycle of the access in the run without a cache
+    uint8_t width;
+    operation_t op;
+} sweep_access_t;
+
+typedef struct sweep_config {
+    struct sweep *sweep;
+    int A, B, C, d;
+    cache_t *cache;
+    dram_t *dram;           // this configuration's own memory, if modeled
+    uint64_t stall;         // cycles spent waiting on misses so far
+    bool stopped;           // this configuration would already have hit the cycle limit
+    pthread_t thread;
+} sweep_config_t;
+
+// The sweep of one machine, so that every machine in the process can have its own.
+typedef struct sweep {
+    sweep_config_t configs[SWEEP_MAX];
+    unsigned num_configs;
+    uint64_t limit;             // cycle limit of the machine being swept
+    sweep_access_t bufs[2][SWEEP_CHUNK];
+    unsigned buf_len[2];
+    bool buf_last[2];           // no more buffers follow this one
+    unsigned cur;               // buffer being filled by the pipeline
+    pthread_barrier_t handoff;
+} sweep_t;
+
+static void sweep_replay(sweep_config_t *cfg, const sweep_access_t *acc) {
+    cache_t *cache = cfg->cache;
+    uint64_t limit = cfg->sweep->limit;
+    // Cycle of the first attempt at this access in this configuration.
+    uint64_t now = acc->cycle + cfg->stall;
+    word_t data = 0;
+    evicted_line_t evicted;
+
+    if (cfg->stopped)
+        return;
+    if (now >= limit) {
+        cfg->stopped = true;
+        return;
+    }
+
+    uint64_t last = (acc->addr + acc->width - 1) & ~(uint64_t) (cache->B - 1);
+    for (uint64_t line = acc->addr & ~(uint64_t) (cache->B - 1); line <= last; line += cache->B) {
+        if (check_hit(cache, line, acc->op))
+            continue;
+        // One more attempt per cycle until the line arrives on the d-th.
+        uint64_t retries = (cfg->dram ? dram_access(cfg->dram, line, now) : (uint64_t) cache->d) - 1;
+        if (now + retries >= limit) {
+            retries = limit - 1 - now;
+            cfg->stopped = true;
+        }
+        cfg->stall += retries;
+        now += retries;
+        if (cfg->stopped)
+            return;
+
+        replace_line(cache, line, acc->op, &evicted);
+    }
+    if (acc->op == READ)
+        get_word_cache(cache, acc->addr, &data);
+    else
+        set_word_cache(cache, acc->addr, data);
+}
+
+static void *sweep_worker(void *arg) {
+    sweep_config_t *cfg = (sweep_config_t *) arg;
+    sweep_t *sw = cfg->sweep;
+    unsigned b = 0;
+    bool last;
+
+    do {
+        pthread_barrier_wait(&sw->handoff);
+        for (unsigned i = 0; i < sw->buf_len[b]; i++)
+            sweep_replay(cfg, &sw->bufs[b][i]);
+        last = sw->buf_last[b];
+        b ^= 1;
+    } while (!last);
+    return NULL;
+}
+
+// Hand the buffer being filled to the workers, once they are done with the other one.
+static void sweep_publish(sweep_t *sw, bool last) {
+    sw->buf_last[sw->cur] = last;
+    pthread_barrier_wait(&sw->handoff);
+    sw->cur ^= 1;
+    sw->buf_len[sw->cur] = 0;
+}
+
+void sweep_start(machine_t *m) {
+    sweep_t *sw;
+
+    if (m->num_sweep == 0)
+        return;
+    sw = calloc(1, sizeof(sweep_t));
+    sw->num_configs = m->num_sweep;
+    sw->limit = m->cycle_max;
+    pthread_barrier_init(&sw->handoff, NULL, sw->num_configs + 1);
+    for (unsigned i = 0; i < sw->num_configs; i++) {
+        sweep_config_t *cfg = &sw->configs[i];
+        cfg->sweep = sw;
+        cfg->A = m->sweep_specs[i].A;
+        cfg->B = m->sweep_specs[i].B;
+        cfg->C = m->sweep_specs[i].C;
+        cfg->d = m->sweep_specs[i].d;
+        cfg->cache = create_cache_policy(cfg->A, cfg->B, cfg->C, cfg->d, m->policy, false);
+        cfg->dram = m->dram ? create_dram(&m->dram->spec) : NULL;
+        cfg->stall = 0;
+        cfg->stopped = false;
+        pthread_create(&cfg->thread, NULL, sweep_worker, cfg);
+    }
+    m->sweep = sw;
+}
+
+void sweep_access(const machine_t *m, uint64_t addr, unsigned width, operation_t op) {
+    sweep_t *sw = m->sweep;
+    sweep_access_t *acc = &sw->bufs[sw->cur][sw->buf_len[sw->cur]++];
+    acc->addr = addr;
+    acc->cycle = m->num_instr;
+    acc->width = width;
+    acc->op = op;
+    if (sw->buf_len[sw->cur] == SWEEP_CHUNK)
+        sweep_publish(sw, false);
+}
+
+void sweep_finish(machine_t *m) {
+    sweep_t *sw = m->sweep;
+    uint64_t cycles = m->num_instr, limit = sw->limit;
+
+    m->sweep = NULL;
+    sweep_publish(sw, true);
+    for (unsigned i = 0; i < sw->num_configs; i++)
+        pthread_join(sw->configs[i].thread, NULL);
+    pthread_barrier_destroy(&sw->handoff);
+
+    fprintf(outfile, "A,B,C,d,cycles,hits,misses\n");
+    for (unsigned i = 0; i < sw->num_configs; i++) {
+        sweep_config_t *cfg = &sw->configs[i];
+        uint64_t total = cfg->stopped ? limit : cycles + cfg->stall;
+        if (total > limit)
+            total = limit;
+        fprintf(outfile, "%d,%d,%d,%d,%ld,%d,%d\n", cfg->A, cfg->B, cfg->C, cfg->d, total,
+                cfg->cache->hit_count, cfg->cache->miss_count);
+        free_cache(cfg->cache);
+        if (cfg->dram)
+            free_dram(cfg->dram);
+    }
+    free(sw);
+}
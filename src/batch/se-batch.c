@@ -0,0 +1,434 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * se-batch.c - Run a file of simulation jobs on a pool of worker threads.
+ *
+ * Each line of the job file names a binary, the cache parameters, the cycle
+ * limit and an optional checkpoint file, exactly what one run of se would take
+ * on its command line. Every job gets its own machine_t, so the workers run
+ * jobs side by side in one process. When all jobs are done, one row per job
+ * is written as CSV or JSON, in the order of the job file, to the results
+ * file; stdout is left to the output of the programs being run.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <elf.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "archsim.h"
+
+#define MAX_JOB_LINE 1024
+
+typedef struct job {
+    // From the job file
+    char *binary;
+    int A, B, C, d;             // -1 for no cache
+    uint64_t cycle_max;
+    char *checkpoint;           // NULL for no checkpoint
+    // Results
+    bool ok;
+    const char *error;
+    uint64_t cycles;
+    int hits, misses;           // data cache line lookups
+    stat_t status;
+    double wall;                // host seconds
+} job_t;
+
+/* Globals the simulator core expects from its front end (see archsim.c). */
+opcode_t        itable[2<<11];
+FILE            *infile, *outfile, *errfile, *checkpoint;
+char            *infile_name;
+char            *hw_prompt;
+uint64_t        cycle_max;
+uint64_t        ffwd_max;
+exec_mode_t     exec_mode;
+int             debug_level;
+int             A, B, C, d;
+// Set from the command line for every job's cache.
+replacement_t   replacement;
+unsigned        mshrs;
+unsigned        wbuf;
+bool            have_icache;
+cache_spec_t    icache_spec;
+cache_spec_t    outer_specs[MAX_OUTER];
+unsigned        num_outer;
+inclusion_t     inclusion;
+prefetch_kind_t prefetch;
+unsigned        prefetch_degree = 1;
+bool            have_dram;
+dram_spec_t     dram_spec;
+
+static job_t *jobs;
+static unsigned num_jobs;
+static unsigned next_job;       // next job a worker will take
+
+static char *stat_names[] = {"BUB", "AOK", "HLT", "ADR", "INS"};
+
+static void usage(char *argv[]) {
+    printf("Usage: %s -i <file> -o <file> [OPTIONS]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -i <file>  Input. The job file to run. This argument is MANDATORY.\n");
+    printf("             Each line holds: <binary> <A> <B> <C> <d> <cycle limit> [<checkpoint file>]\n");
+    printf("             Use - for A, B, C and d to run without a cache, and - or no checkpoint to skip it.\n");
+    printf("             Blank lines and lines starting with # are ignored.\n");
+    printf("  -o <file>  Output. Write the results to <file>. This argument is MANDATORY: stdout carries the\n");
+    printf("             output of the programs the jobs run.\n");
+    printf("  -n <num>   Threads. Run <num> jobs at a time. Defaults to the number of online CPUs.\n");
+    printf("  -f <fmt>   Format. csv (the default) or json.\n");
+    printf("  -r <name>  Replacement. The policy of every job's cache: lru (the default), plru, nru, srrip, brrip or random.\n");
+    printf("  -m <num>   MSHRs. Make every job's cache non-blocking, with up to <num> misses outstanding.\n");
+    printf("  -w <num>   Write buffer. Give every job's cache a write buffer of <num> lines, as se -w does.\n");
+    printf("  -I <A:B:C> Instruction cache. Give every job with a cache an L1 instruction cache, as se -I does.\n");
+    printf("  -L <list>  Lower levels. Put an L2 and optionally an L3 below every job's cache, as se -L does.\n");
+    printf("  -H <name>  Inclusion. non-inclusive (the default), inclusive or exclusive, as se -H.\n");
+    printf("  -p <name>  Prefetcher. none (the default), next-line, stride or stream, as se -p.\n");
+    printf("  -P <num>   Prefetch degree. The number of lines each prefetch trigger asks for, as se -P.\n");
+    printf("  -D <spec>  DRAM. Time every job's misses to memory with a model, as se -D does.\n");
+    printf("  -v         Verbose. Show the log messages of every job.\n");
+}
+
+static int parse_cache_param(const char *s) {
+    return strcmp(s, "-") ? atoi(s) : -1;
+}
+
+/* Read the job file. Returns false (after logging why) if it is malformed. */
+static bool read_jobs(FILE *f) {
+    char line[MAX_JOB_LINE], printbuf[BUF_LEN];
+    unsigned cap = 0, lineno = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        char binary[MAX_JOB_LINE], ckpt[MAX_JOB_LINE], a[32], b[32], c[32], dd[32];
+        unsigned long long limit;
+        int n;
+
+        lineno++;
+        if (sscanf(line, " %1[#]", binary) == 1 || sscanf(line, " %s", binary) != 1)
+            continue;
+        n = sscanf(line, "%s %31s %31s %31s %31s %llu %s", binary, a, b, c, dd, &limit, ckpt);
+        if (n < 6) {
+            sprintf(printbuf, "Malformed job on line %u.", lineno);
+            logging(LOG_ERROR, printbuf);
+            return false;
+        }
+        if (num_jobs == cap) {
+            cap = cap ? 2 * cap : 64;
+            jobs = realloc(jobs, cap * sizeof(job_t));
+        }
+        job_t *job = &jobs[num_jobs++];
+        memset(job, 0, sizeof(job_t));
+        job->binary = strdup(binary);
+        job->A = parse_cache_param(a);
+        job->B = parse_cache_param(b);
+        job->C = parse_cache_param(c);
+        job->d = parse_cache_param(dd);
+        job->cycle_max = limit;
+        job->checkpoint = (n == 7 && strcmp(ckpt, "-")) ? strdup(ckpt) : NULL;
+    }
+    return true;
+}
+
+/* The same checks se and the sweep make before creating a cache. */
+static bool valid_cache(const job_t *job) {
+    if (job->A == -1 || job->B == -1 || job->C == -1 || job->d == -1)
+        return job->A == -1 && job->B == -1 && job->C == -1 && job->d == -1;
+    return job->A >= 1 && job->B >= 8 && __builtin_popcountll(job->B) == 1
+        && job->C >= job->A * job->B && __builtin_popcountll(job->C / (job->A * job->B)) == 1
+        && job->d >= 1;
+}
+
+/* Whether the binary is an AArch64 ELF executable whose headers lie within
+ * it; loadElf asserts rather than reports this, which would end every job. */
+static bool is_executable(const char *path) {
+    Elf64_Ehdr header;
+    struct stat st;
+    FILE *f = fopen(path, "rb");
+    bool ok = f && fread(&header, sizeof(header), 1, f) == 1 && fstat(fileno(f), &st) == 0
+        && !memcmp(header.e_ident, ELFMAG, SELFMAG) && header.e_ident[EI_CLASS] == ELFCLASS64
+        && header.e_type == ET_EXEC && header.e_machine == EM_AARCH64
+        && header.e_phoff + (uint64_t) header.e_phnum * header.e_phentsize <= (uint64_t) st.st_size
+        && header.e_shoff + (uint64_t) header.e_shnum * header.e_shentsize <= (uint64_t) st.st_size
+        && header.e_shstrndx < header.e_shnum;
+
+    if (f)
+        fclose(f);
+    return ok;
+}
+
+static void run_job(job_t *job) {
+    struct timespec start, end;
+    machine_t machine;
+
+    if (access(job->binary, R_OK)) {
+        job->error = "cannot read binary";
+        return;
+    }
+    if (!is_executable(job->binary)) {
+        job->error = "not an AArch64 ELF executable";
+        return;
+    }
+    if (!valid_cache(job)) {
+        job->error = "invalid cache configuration";
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // Only a checkpoint shows the memory contents a cache with data would leave.
+    init_machine(&machine, job->A, job->B, job->C, job->d, !job->checkpoint, replacement);
+    if (machine.cache)
+        init_hierarchy(&machine, have_icache ? &icache_spec : NULL, outer_specs, num_outer, inclusion);
+    machine.cycle_max = job->cycle_max;
+    machine.exec_mode = EXEC_PIPE;
+    machine.num_mshrs = mshrs;
+    machine.wbuf_size = wbuf;
+    if (have_dram)
+        machine.dram = create_dram(&dram_spec);
+    if (machine.cache && prefetch != PREFETCH_NONE)
+        machine.prefetcher = create_prefetcher(prefetch, prefetch_degree, machine.cache->B);
+    if (job->checkpoint && !(machine.checkpoint = fopen(job->checkpoint, "w"))) {
+        job->error = "cannot open checkpoint file";
+        free_machine(&machine);
+        return;
+    }
+
+    uint64_t entry = loadElf(&machine, job->binary);
+    runElf(&machine, entry);
+
+    if (machine.checkpoint) {
+        log_machine_state(&machine);
+        fclose(machine.checkpoint);
+    }
+    if (machine.cache) {
+        job->hits = machine.cache->hit_count;
+        job->misses = machine.cache->miss_count;
+    }
+    job->cycles = machine.num_instr;
+    job->status = machine.proc->status;
+    free_machine(&machine);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    job->wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    job->ok = true;
+}
+
+static void *worker(void *unused) {
+    unsigned i;
+    while ((i = __atomic_fetch_add(&next_job, 1, __ATOMIC_RELAXED)) < num_jobs)
+        run_job(&jobs[i]);
+    return NULL;
+}
+
+/* Write s as a CSV field, quoted (with its quotes doubled) if it holds a comma, quote or newline. */
+static void print_csv_field(FILE *f, const char *prefix, const char *s) {
+    if (!strpbrk(s, ",\"\r\n")) {
+        fprintf(f, "%s%s", prefix, s);
+        return;
+    }
+    fprintf(f, "\"%s", prefix);
+    for (; *s; s++) {
+        if (*s == '"')
+            fputc('"', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void print_csv(FILE *f) {
+    fprintf(f, "binary,A,B,C,d,limit,checkpoint,cycles,hits,misses,status,wall_s\n");
+    for (unsigned i = 0; i < num_jobs; i++) {
+        job_t *job = &jobs[i];
+        print_csv_field(f, "", job->binary);
+        fprintf(f, ",%d,%d,%d,%d,%lu,", job->A, job->B, job->C, job->d, job->cycle_max);
+        print_csv_field(f, "", job->checkpoint ? job->checkpoint : "");
+        if (job->ok) {
+            fprintf(f, ",%lu,%d,%d,%s,%.6f\n", job->cycles, job->hits, job->misses,
+                    stat_names[job->status], job->wall);
+        } else {
+            fprintf(f, ",,,,");
+            print_csv_field(f, "ERROR: ", job->error);
+            fprintf(f, ",\n");
+        }
+    }
+}
+
+/* Write s as a JSON string. */
+static void print_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void print_json(FILE *f) {
+    fprintf(f, "[\n");
+    for (unsigned i = 0; i < num_jobs; i++) {
+        job_t *job = &jobs[i];
+        fprintf(f, "  {\"binary\": ");
+        print_json_string(f, job->binary);
+        fprintf(f, ", \"A\": %d, \"B\": %d, \"C\": %d, \"d\": %d, \"limit\": %lu, ",
+                job->A, job->B, job->C, job->d, job->cycle_max);
+        if (job->checkpoint) {
+            fprintf(f, "\"checkpoint\": ");
+            print_json_string(f, job->checkpoint);
+            fprintf(f, ", ");
+        } else
+            fprintf(f, "\"checkpoint\": null, ");
+        if (job->ok)
+            fprintf(f, "\"cycles\": %lu, \"hits\": %d, \"misses\": %d, \"status\": \"%s\", \"wall_s\": %.6f}",
+                    job->cycles, job->hits, job->misses, stat_names[job->status], job->wall);
+        else
+            fprintf(f, "\"error\": \"%s\"}", job->error);
+        fprintf(f, i + 1 < num_jobs ? ",\n" : "\n");
+    }
+    fprintf(f, "]\n");
+}
+
+int main(int argc, char *argv[]) {
+    char printbuf[BUF_LEN];
+    char *jobfile_name = NULL;
+    FILE *jobfile, *results = NULL;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool json = false, verbose = false;
+    int option;
+
+    infile = stdin;
+    outfile = stdout;
+    errfile = stderr;
+    debug_level = 0;
+
+    while ((option = getopt(argc, argv, "hi:o:n:f:r:m:w:I:L:H:p:P:D:v")) != -1) {
+        switch (option) {
+            case 'h':
+                usage(argv);
+                exit(EXIT_SUCCESS);
+            case 'i':
+                jobfile_name = optarg;
+                break;
+            case 'o':
+                if ((results = fopen(optarg, "w")) == NULL) {
+                    assert(strlen(optarg) < BUF_LEN);
+                    sprintf(printbuf, "failed to open output file %s", optarg);
+                    logging(LOG_FATAL, printbuf);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n':
+                num_threads = atol(optarg);
+                break;
+            case 'f':
+                if (!strcmp(optarg, "json")) {
+                    json = true;
+                } else if (strcmp(optarg, "csv")) {
+                    logging(LOG_ERROR, "Invalid format, options are csv and json.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'r':
+                if (!parse_replacement(optarg, &replacement)) {
+                    logging(LOG_ERROR, "Invalid replacement policy, options are lru, plru, nru, srrip, brrip and random.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'm':
+                mshrs = atoi(optarg);
+                if (mshrs > MAX_MSHRS) {
+                    sprintf(printbuf, "At most %d MSHRs are supported.", MAX_MSHRS);
+                    logging(LOG_ERROR, printbuf);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'w':
+                wbuf = atoi(optarg);
+                if (wbuf > MAX_WBUF) {
+                    sprintf(printbuf, "A write buffer can hold at most %d lines.", MAX_WBUF);
+                    logging(LOG_ERROR, printbuf);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'I':
+                if (parse_cache_specs(optarg, &icache_spec, 1, false) == 0)
+                    exit(EXIT_FAILURE);
+                have_icache = true;
+                break;
+            case 'L':
+                if ((num_outer = parse_cache_specs(optarg, outer_specs, MAX_OUTER, true)) == 0)
+                    exit(EXIT_FAILURE);
+                break;
+            case 'H':
+                if (!parse_inclusion(optarg, &inclusion)) {
+                    logging(LOG_ERROR, "Invalid inclusion policy, options are non-inclusive, inclusive and exclusive.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'p':
+                if (!parse_prefetcher(optarg, &prefetch)) {
+                    logging(LOG_ERROR, "Invalid prefetcher, options are none, next-line, stride and stream.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'P':
+                prefetch_degree = atoi(optarg);
+                if (prefetch_degree < 1 || prefetch_degree > MAX_PREFETCH_DEGREE) {
+                    sprintf(printbuf, "The prefetch degree must be between 1 and %d.", MAX_PREFETCH_DEGREE);
+                    logging(LOG_ERROR, printbuf);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'D':
+                if (!parse_dram(optarg, &dram_spec))
+                    exit(EXIT_FAILURE);
+                have_dram = true;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                usage(argv);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (!jobfile_name || !results) {
+        usage(argv);
+        exit(EXIT_FAILURE);
+    }
+    if ((jobfile = fopen(jobfile_name, "r")) == NULL) {
+        perror(jobfile_name);
+        exit(EXIT_FAILURE);
+    }
+    if (!read_jobs(jobfile))
+        exit(EXIT_FAILURE);
+    fclose(jobfile);
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > num_jobs)
+        num_threads = num_jobs;
+
+    init_itable();
+    // The jobs' own log messages would interleave with each other.
+    if (!verbose)
+        errfile = fopen("/dev/null", "w");
+
+    pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+    for (long i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, worker, NULL);
+    for (long i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    if (json)
+        print_json(results);
+    else
+        print_csv(results);
+    fclose(results);
+    return EXIT_SUCCESS;
+}
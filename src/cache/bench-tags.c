@@ -0,0 +1,113 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * bench-tags.c - Microbenchmark for the cache's tag lookup.
+ *
+ * Times get_line on a cache_t, whose tags are packed per set and compared
+ * several ways at a time, against the same lookup over the previous layout,
+ * in which every line was one record holding its valid bit, tag, dirty bit,
+ * LRU counter and data pointer. Both caches hold the same lines and look up
+ * the same addresses, about half of which hit.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cache.h"
+
+#define NUM_LOOKUPS (1 << 24)
+
+/* A line as the cache stored it before the tags were split out. */
+typedef struct aos_line {
+    bool valid;
+    uword_t tag;
+    bool dirty;
+    uword_t lru;
+    byte_t *data;
+} aos_line_t;
+
+typedef struct aos_cache {
+    aos_line_t *lines;      /* S * A lines, set by set */
+    unsigned int A, b, s;
+    uword_t set_mask, next_lru;
+} aos_cache_t;
+
+/* get_line over the old layout. */
+static aos_line_t *aos_get_line(aos_cache_t *cache, uword_t addr) {
+    uword_t tag = addr >> (cache->b + cache->s);
+    aos_line_t *lines = &cache->lines[((addr >> cache->b) & cache->set_mask) * cache->A];
+
+    for (unsigned int j = 0; j < cache->A; j++) {
+        if (lines[j].tag == tag && lines[j].valid) {
+            cache->next_lru++;
+            return &lines[j];
+        }
+    }
+    return NULL;
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(unsigned int A, unsigned int B, unsigned int C, const uword_t *addrs) {
+    unsigned int S = C / (A * B);
+    cache_t *cache = create_cache(A, B, C, 1);
+    aos_cache_t aos = {calloc((size_t) S * A, sizeof(aos_line_t)), A, cache->b, cache->s, S - 1, 0};
+    unsigned long soa_hits = 0, aos_hits = 0;
+    double start, soa_time, aos_time;
+
+    /* Fill both caches with the same lines: every other block of twice the capacity. */
+    for (uword_t addr = 0; addr < 2 * (uword_t) C; addr += 2 * B) {
+        evicted_line_t evicted;
+        replace_line(cache, addr, READ, &evicted);
+    }
+    for (unsigned int i = 0; i < S; i++) {
+        for (unsigned int j = 0; j < A; j++) {
+            aos.lines[i * A + j].valid = cache->tags[i * A + j] != TAG_INVALID;
+            aos.lines[i * A + j].tag = cache->tags[i * A + j];
+        }
+    }
+
+    start = seconds();
+    for (unsigned int i = 0; i < NUM_LOOKUPS; i++)
+        soa_hits += get_line(cache, addrs[i]) != NULL;
+    soa_time = seconds() - start;
+
+    start = seconds();
+    for (unsigned int i = 0; i < NUM_LOOKUPS; i++)
+        aos_hits += aos_get_line(&aos, addrs[i]) != NULL;
+    aos_time = seconds() - start;
+
+    if (soa_hits != aos_hits) {
+        fprintf(stderr, "A=%u: the layouts disagree (%lu vs %lu hits)\n", A, soa_hits, aos_hits);
+        exit(EXIT_FAILURE);
+    }
+    printf("%u,%u,%u,%.2f,%.2f,%.2f\n", A, B, C, aos_time * 1e9 / NUM_LOOKUPS,
+           soa_time * 1e9 / NUM_LOOKUPS, aos_time / soa_time);
+    free(aos.lines);
+    free_cache(cache);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int ways[] = {1, 2, 4, 8, 16, 32, 64};
+    unsigned int B = 64, C = 1 << 20;
+    uword_t *addrs = malloc(NUM_LOOKUPS * sizeof(uword_t));
+
+    /* Random blocks of twice the capacity, so about half of the lookups hit. */
+    srand(429);
+    for (unsigned int i = 0; i < NUM_LOOKUPS; i++)
+        addrs[i] = ((uword_t) rand() % (2 * C / B)) * B;
+
+    printf("A,B,C,old_ns_per_lookup,new_ns_per_lookup,speedup\n");
+    for (unsigned int i = 0; i < sizeof(ways) / sizeof(ways[0]); i++)
+        bench(ways[i], B, C, addrs);
+    free(addrs);
+    return EXIT_SUCCESS;
+}
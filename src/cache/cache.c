@@ -3,8 +3,8 @@
  * 
  * cache.c - A cache simulator that can replay traces from Valgrind
  *     and output statistics such as number of hits, misses, and
- *     evictions, both dirty and clean.  The replacement policy is LRU. 
- *     The cache is a writeback cache. 
+ *     evictions, both dirty and clean.  The replacement policy is LRU
+ *     unless another is chosen.  The cache is a writeback cache. 
  * 
  * Copyright (c) 2021, 2023, 2024, 2025. 
  * Authors: M. Hinton, Z. Leeper.
@@ -19,6 +19,9 @@
 #include <limits.h>
 #include <string.h>
 #include <errno.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 #include "cache.h"
 
 
@@ -26,24 +29,9 @@
 
 #define ADDRESS_LENGTH 64
 
-/* Counters used to record cache statistics in printSummary().
+/* The statistics used by printSummary() live in cache_t.
    test-cache uses these numbers to verify correctness of the cache. */
 
-//Increment when a miss occurs
-int miss_count = 0;
-
-//Increment when a hit occurs
-int hit_count = 0;
-
-//Increment when a dirty eviction occurs
-int dirty_eviction_count = 0;
-
-//Increment when a clean eviction occurs
-int clean_eviction_count = 0;
-
-/* STUDENT TO-DO: add more globals, structs, macros if necessary */
-uword_t next_lru;
-
 uword_t bitfield_u64(uword_t src, unsigned frompos, unsigned width);
 static size_t _log(size_t x) {
   size_t result = 0;
@@ -53,6 +41,343 @@ static size_t _log(size_t x) {
   return result;
 } 
 
+/*
+ * Tag lookups within a set. Up to 4 ways, comparing the tags one by one with
+ * the ways unrolled is fastest. On x86-64, larger sets with an even number of
+ * ways compare two tags at a time with SSE2, or four at a time with AVX2 when
+ * the number of ways is a multiple of 4 and the host supports it. Elsewhere
+ * 8 and 16 ways are unrolled too, and anything else uses the loop.
+ */
+#define MATCH(j) if (tags[j] == tag) return j
+
+static int find_way_any(const uword_t *tags, uword_t tag, unsigned int A) {
+    for (unsigned int j = 0; j < A; j++) {
+        MATCH(j);
+    }
+    return -1;
+}
+
+static int find_way_1(const uword_t *tags, uword_t tag, unsigned int A) {
+    MATCH(0);
+    return -1;
+}
+
+static int find_way_2(const uword_t *tags, uword_t tag, unsigned int A) {
+    MATCH(0); MATCH(1);
+    return -1;
+}
+
+static int find_way_4(const uword_t *tags, uword_t tag, unsigned int A) {
+    MATCH(0); MATCH(1); MATCH(2); MATCH(3);
+    return -1;
+}
+
+static int find_way_8(const uword_t *tags, uword_t tag, unsigned int A) {
+    MATCH(0); MATCH(1); MATCH(2); MATCH(3);
+    MATCH(4); MATCH(5); MATCH(6); MATCH(7);
+    return -1;
+}
+
+static int find_way_16(const uword_t *tags, uword_t tag, unsigned int A) {
+    MATCH(0);  MATCH(1);  MATCH(2);  MATCH(3);
+    MATCH(4);  MATCH(5);  MATCH(6);  MATCH(7);
+    MATCH(8);  MATCH(9);  MATCH(10); MATCH(11);
+    MATCH(12); MATCH(13); MATCH(14); MATCH(15);
+    return -1;
+}
+#undef MATCH
+
+#ifdef __x86_64__
+static int find_way_sse2(const uword_t *tags, uword_t tag, unsigned int A) {
+    __m128i key = _mm_set1_epi64x(tag);
+    for (unsigned int j = 0; j < A; j += 2) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (tags + j)), key);
+        // SSE2 has no 64-bit compare: a tag matches if both of its halves do.
+        eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+        if (mask) return j + __builtin_ctz(mask);
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+static int find_way_avx2(const uword_t *tags, uword_t tag, unsigned int A) {
+    __m256i key = _mm256_set1_epi64x(tag);
+    for (unsigned int j = 0; j < A; j += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (tags + j)), key);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        if (mask) return j + __builtin_ctz(mask);
+    }
+    return -1;
+}
+#endif
+
+/*
+ * Replacement policies. Each set's state is an array of 64-bit words; the
+ * first counts the valid ways and is handled here, the rest belong
+ * to the policy. Sets of up to 64 ways keep one word per bitmap, so the bit
+ * operations below run in constant time.
+ */
+#define BITMAP_WORDS(A) (((A) + 63) / 64)
+#define BIT_GET(map, i) (((map)[(i) / 64] >> ((i) % 64)) & 1)
+#define BIT_SET(map, i) ((map)[(i) / 64] |= 1ULL << ((i) % 64))
+#define BIT_CLEAR(map, i) ((map)[(i) / 64] &= ~(1ULL << ((i) % 64)))
+
+static uint64_t next_rand(cache_t *cache) {
+    // xorshift64, seeded the same for every cache so runs are repeatable
+    uint64_t x = cache->rand_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return cache->rand_state = x;
+}
+
+// The lowest way whose bit is set in map, or -1.
+static int first_set(const uint64_t *map, unsigned int A) {
+    for (unsigned int w = 0; w < BITMAP_WORDS(A); w++) {
+        if (map[w]) return w * 64 + __builtin_ctzll(map[w]);
+    }
+    return -1;
+}
+
+static size_t no_words(unsigned int A) {
+    return 0;
+}
+
+static void no_init(cache_t *cache, uint64_t *set) {
+}
+
+static void no_touch(cache_t *cache, uint64_t *set, unsigned int way) {
+}
+
+/*
+ * LRU: a doubly linked recency stack, kept as 32-bit indices. Word 0 holds
+ * the most and least recently used ways, and word 1 + j the ways used just
+ * before and after way j.
+ */
+#define LRU_NONE 0xFFFFFFFFU
+#define LRU_MRU(s) ((uint32_t *) (s))[0]
+#define LRU_LRU(s) ((uint32_t *) (s))[1]
+#define LRU_OLDER(s, j) ((uint32_t *) (s))[2 + 2 * (j)]
+#define LRU_NEWER(s, j) ((uint32_t *) (s))[3 + 2 * (j)]
+
+static size_t lru_words(unsigned int A) {
+    return 1 + A;
+}
+
+static void lru_init(cache_t *cache, uint64_t *set) {
+    for (unsigned int j = 0; j < cache->A; j++) {
+        LRU_OLDER(set, j) = j + 1 < cache->A ? j + 1 : LRU_NONE;
+        LRU_NEWER(set, j) = j > 0 ? j - 1 : LRU_NONE;
+    }
+    LRU_MRU(set) = 0;
+    LRU_LRU(set) = cache->A - 1;
+}
+
+static void lru_touch(cache_t *cache, uint64_t *set, unsigned int way) {
+    uint32_t newer = LRU_NEWER(set, way), older = LRU_OLDER(set, way);
+
+    if (newer == LRU_NONE)
+        return;
+    // Unlink the way, then push it on top of the stack.
+    LRU_OLDER(set, newer) = older;
+    if (older == LRU_NONE)
+        LRU_LRU(set) = newer;
+    else
+        LRU_NEWER(set, older) = newer;
+    LRU_OLDER(set, way) = LRU_MRU(set);
+    LRU_NEWER(set, way) = LRU_NONE;
+    LRU_NEWER(set, LRU_MRU(set)) = way;
+    LRU_MRU(set) = way;
+}
+
+static unsigned int lru_victim(cache_t *cache, uint64_t *set) {
+    return LRU_LRU(set);
+}
+
+/*
+ * Tree PLRU over the ways, padded to P, the next power of two. Node 1 is the
+ * root and node n has children 2n and 2n + 1; way j is leaf P + j. A node's
+ * bit is 0 if the victim lies to its left and 1 if it lies to its right.
+ */
+static unsigned int plru_leaves(unsigned int A) {
+    unsigned int P = 1;
+    while (P < A) P <<= 1;
+    return P;
+}
+
+static size_t plru_words(unsigned int A) {
+    return BITMAP_WORDS(plru_leaves(A));
+}
+
+static void plru_touch(cache_t *cache, uint64_t *set, unsigned int way) {
+    // Point every node on the way's path away from it.
+    for (unsigned int n = plru_leaves(cache->A) + way; n > 1; n >>= 1) {
+        if (n & 1)
+            BIT_CLEAR(set, n >> 1);
+        else
+            BIT_SET(set, n >> 1);
+    }
+}
+
+static unsigned int plru_victim(cache_t *cache, uint64_t *set) {
+    unsigned int P = plru_leaves(cache->A), n = 1;
+
+    while (n < P) {
+        unsigned int child = 2 * n + BIT_GET(set, n), leaf = child;
+        // Padding leaves hold no ways, so never descend into them alone.
+        while (leaf < P) leaf <<= 1;
+        n = leaf - P < cache->A ? child : 2 * n;
+    }
+    return n - P;
+}
+
+/*
+ * NRU: one referenced bit per way, followed by the number of bits set. When
+ * the last one is set, all the others are cleared. The victim is the first
+ * way not referenced.
+ */
+static size_t nru_words(unsigned int A) {
+    return BITMAP_WORDS(A) + 1;
+}
+
+static void nru_touch(cache_t *cache, uint64_t *set, unsigned int way) {
+    uint64_t *count = &set[BITMAP_WORDS(cache->A)];
+
+    if (BIT_GET(set, way))
+        return;
+    BIT_SET(set, way);
+    if (++*count == cache->A) {
+        memset(set, 0, BITMAP_WORDS(cache->A) * sizeof(uint64_t));
+        BIT_SET(set, way);
+        *count = 1;
+    }
+}
+
+static unsigned int nru_victim(cache_t *cache, uint64_t *set) {
+    for (unsigned int w = 0; w < BITMAP_WORDS(cache->A); w++) {
+        if (~set[w]) {
+            unsigned int way = w * 64 + __builtin_ctzll(~set[w]);
+            // Only a one-way set ever has every bit set.
+            return way < cache->A ? way : 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * RRIP: a 2-bit re-reference prediction value per way, kept as one bitmap
+ * per value so aging the whole set is a shift of the bitmaps. A hit predicts
+ * a near re-reference (0). SRRIP inserts at a long interval (2), BRRIP at a
+ * distant one (3) but for one fill in 32. The victim is the first way at 3,
+ * after aging the set just enough for there to be one.
+ */
+#define RRPV_MAX 3
+#define RRPV_MAP(cache, set, v) (&(set)[(v) * BITMAP_WORDS((cache)->A)])
+
+static size_t rrip_words(unsigned int A) {
+    return (RRPV_MAX + 1) * BITMAP_WORDS(A);
+}
+
+static void rrip_set(cache_t *cache, uint64_t *set, unsigned int way, unsigned int rrpv) {
+    for (unsigned int v = 0; v <= RRPV_MAX; v++)
+        BIT_CLEAR(RRPV_MAP(cache, set, v), way);
+    BIT_SET(RRPV_MAP(cache, set, rrpv), way);
+}
+
+static void rrip_touch(cache_t *cache, uint64_t *set, unsigned int way) {
+    rrip_set(cache, set, way, 0);
+}
+
+static void srrip_insert(cache_t *cache, uint64_t *set, unsigned int way) {
+    rrip_set(cache, set, way, RRPV_MAX - 1);
+}
+
+static void brrip_insert(cache_t *cache, uint64_t *set, unsigned int way) {
+    rrip_set(cache, set, way, next_rand(cache) % 32 ? RRPV_MAX : RRPV_MAX - 1);
+}
+
+static unsigned int rrip_victim(cache_t *cache, uint64_t *set) {
+    size_t words = BITMAP_WORDS(cache->A);
+    int way = first_set(RRPV_MAP(cache, set, RRPV_MAX), cache->A);
+
+    if (way >= 0)
+        return way;
+    // Age every way by the distance from the oldest value present to RRPV_MAX.
+    unsigned int oldest = RRPV_MAX - 1;
+    while (first_set(RRPV_MAP(cache, set, oldest), cache->A) < 0)
+        oldest--;
+    unsigned int age = RRPV_MAX - oldest;
+    for (int v = RRPV_MAX; v >= 0; v--) {
+        if (v >= (int) age)
+            memcpy(RRPV_MAP(cache, set, v), RRPV_MAP(cache, set, v - age), words * sizeof(uint64_t));
+        else
+            memset(RRPV_MAP(cache, set, v), 0, words * sizeof(uint64_t));
+    }
+    return first_set(RRPV_MAP(cache, set, RRPV_MAX), cache->A);
+}
+
+static unsigned int random_victim(cache_t *cache, uint64_t *set) {
+    return next_rand(cache) % cache->A;
+}
+
+static const repl_ops_t repl_ops[NUM_REPL] = {
+    [REPL_LRU]    = {"lru",    lru_words,  lru_init, lru_touch,  lru_touch,    lru_victim},
+    [REPL_PLRU]   = {"plru",   plru_words, no_init,  plru_touch, plru_touch,   plru_victim},
+    [REPL_NRU]    = {"nru",    nru_words,  no_init,  nru_touch,  nru_touch,    nru_victim},
+    [REPL_SRRIP]  = {"srrip",  rrip_words, no_init,  rrip_touch, srrip_insert, rrip_victim},
+    [REPL_BRRIP]  = {"brrip",  rrip_words, no_init,  rrip_touch, brrip_insert, rrip_victim},
+    [REPL_RANDOM] = {"random", no_words,   no_init,  no_touch,   no_touch,     random_victim},
+};
+
+bool parse_replacement(const char *name, replacement_t *policy) {
+    for (int i = 0; i < NUM_REPL; i++) {
+        if (!strcmp(name, repl_ops[i].name)) {
+            *policy = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *replacement_name(replacement_t policy) {
+    return repl_ops[policy].name;
+}
+
+// The replacement state of the set holding entry index of tags and lines.
+static uint64_t *set_state(cache_t *cache, size_t index) {
+    return cache->repl_state + index / cache->A * cache->repl_words;
+}
+
+// Alignment of the two allocations, the size of a host cache line.
+#define HOST_LINE 64
+
+static size_t round_up(size_t n) {
+    return (n + HOST_LINE - 1) & ~(size_t) (HOST_LINE - 1);
+}
+
+// Bytes for the tags and line metadata of a cache with the given number of ways in all.
+static size_t lines_size(size_t ways) {
+    return round_up(ways * (sizeof(uword_t) + sizeof(cache_line_t)));
+}
+
+// Bytes for the whole metadata slab: the tags, the lines and the replacement state.
+static size_t meta_size(cache_t *cache) {
+    size_t ways = (size_t) cache->C / cache->B;
+    return lines_size(ways) + round_up(ways / cache->A * cache->repl_words * sizeof(uint64_t));
+}
+
+static size_t data_size(size_t C) {
+    return round_up(C);
+}
+
+// The data of a line, or NULL in a tag-only cache.
+byte_t *line_data(cache_t *cache, cache_line_t *line) {
+    if (!cache->data)
+        return NULL;
+    return cache->data + (line - cache->lines) * cache->B;
+}
+
 /*
  * Initialize the cache according to specified arguments
  * Called by cache-runner so do not modify the function signature
@@ -60,7 +385,7 @@ static size_t _log(size_t x) {
  * The code provided here shows you how to initialize a cache structure
  * defined above. It's not complete and feel free to modify/add code.
  */
-cache_t *create_cache(int A_in, int B_in, int C_in, int d_in) {
+cache_t *create_cache_policy(int A_in, int B_in, int C_in, int d_in, replacement_t policy, bool with_data) {
     /* see cache-runner for the meaning of each argument */
     cache_t *cache = malloc(sizeof(cache_t));
     cache->A = A_in;
@@ -69,35 +394,76 @@ cache_t *create_cache(int A_in, int B_in, int C_in, int d_in) {
     cache->d = d_in;
     unsigned int S = cache->C / (cache->A * cache->B);
 
-    cache->sets = (cache_set_t*) calloc(S, sizeof(cache_set_t));
-    for (unsigned int i = 0; i < S; i++){
-        cache->sets[i].lines = (cache_line_t*) calloc(cache->A, sizeof(cache_line_t));
-        for (unsigned int j = 0; j < cache->A; j++){
-            cache->sets[i].lines[j].valid = 0;
-            cache->sets[i].lines[j].tag   = 0;
-            cache->sets[i].lines[j].lru   = 0;
-            cache->sets[i].lines[j].dirty = 0;
-            cache->sets[i].lines[j].data  = calloc(cache->B, sizeof(byte_t));
-        }
+    cache->policy = policy;
+    cache->repl = &repl_ops[policy];
+    cache->repl_words = 1 + cache->repl->set_words(cache->A);
+    cache->rand_state = 0x9E3779B97F4A7C15ULL;
+
+    size_t ways = (size_t) S * cache->A;
+    cache->tags = (uword_t*) aligned_alloc(HOST_LINE, meta_size(cache));
+    cache->lines = (cache_line_t*) (cache->tags + ways);
+    cache->repl_state = (uint64_t*) ((byte_t*) cache->tags + lines_size(ways));
+    memset(cache->tags, 0xFF, ways * sizeof(uword_t));  // TAG_INVALID
+    memset(cache->lines, 0, ways * sizeof(cache_line_t));
+    memset(cache->repl_state, 0, (size_t) S * cache->repl_words * sizeof(uint64_t));
+    for (unsigned int i = 0; i < S; i++)
+        cache->repl->init(cache, cache->repl_state + i * cache->repl_words + 1);
+    cache->data = NULL;
+    if (with_data) {
+        cache->data = (byte_t*) aligned_alloc(HOST_LINE, data_size(cache->C));
+        memset(cache->data, 0, cache->C);
+    }
+
+    cache->b = _log(cache->B);
+    cache->s = _log(S);
+    cache->set_mask = S - 1;
+    switch (cache->A) {
+        case 1:  cache->find_way = find_way_1; break;
+        case 2:  cache->find_way = find_way_2; break;
+        case 4:  cache->find_way = find_way_4; break;
+        case 8:  cache->find_way = find_way_8; break;
+        case 16: cache->find_way = find_way_16; break;
+        default: cache->find_way = find_way_any; break;
     }
+#ifdef __x86_64__
+    if (cache->A % 4 == 0 && cache->A >= 8 && __builtin_cpu_supports("avx2"))
+        cache->find_way = find_way_avx2;
+    else if (cache->A % 2 == 0 && cache->A >= 8)
+        cache->find_way = find_way_sse2;
+#endif
 
     /* TODO: add more code for initialization */
-    next_lru = 0;
+    cache->hit_count = 0;
+    cache->miss_count = 0;
+    cache->dirty_eviction_count = 0;
+    cache->clean_eviction_count = 0;
     return cache;
 }
 
+cache_t *create_cache(int A_in, int B_in, int C_in, int d_in) {
+    return create_cache_policy(A_in, B_in, C_in, d_in, REPL_LRU, true);
+}
+
+/*
+ * Create a cache that only models timing: it tracks tags, dirty bits and
+ * replacement state but stores no data, so the caller must keep the data in memory.
+ * get_word_cache and set_word_cache update the line state and move nothing.
+ */
+cache_t *create_tag_cache(int A_in, int B_in, int C_in, int d_in) {
+    return create_cache_policy(A_in, B_in, C_in, d_in, REPL_LRU, false);
+}
+
 cache_t *create_checkpoint(cache_t *cache) {
-    unsigned int S = (unsigned int) cache->C / (cache->A * cache->B);
+    size_t ways = (size_t) cache->C / cache->B;
     cache_t *copy_cache = malloc(sizeof(cache_t));
     memcpy(copy_cache, cache, sizeof(cache_t));
-    copy_cache->sets = (cache_set_t*) calloc(S, sizeof(cache_set_t));
-    for (unsigned int i = 0; i < S; i++) {
-        copy_cache->sets[i].lines = (cache_line_t*) calloc(cache->A, sizeof(cache_line_t));
-        for (unsigned int j = 0; j < cache->A; j++) {
-            memcpy(&copy_cache->sets[i].lines[j], &cache->sets[i].lines[j], sizeof(cache_line_t));
-            copy_cache->sets[i].lines[j].data = calloc(cache->B, sizeof(byte_t));
-            memcpy(copy_cache->sets[i].lines[j].data, cache->sets[i].lines[j].data, sizeof(byte_t));
-        }
+    copy_cache->tags = (uword_t*) aligned_alloc(HOST_LINE, meta_size(cache));
+    copy_cache->lines = (cache_line_t*) (copy_cache->tags + ways);
+    copy_cache->repl_state = (uint64_t*) ((byte_t*) copy_cache->tags + lines_size(ways));
+    memcpy(copy_cache->tags, cache->tags, meta_size(cache));
+    if (cache->data) {
+        copy_cache->data = (byte_t*) aligned_alloc(HOST_LINE, data_size(cache->C));
+        memcpy(copy_cache->data, cache->data, cache->C);
     }
     
     return copy_cache;
@@ -106,10 +472,11 @@ cache_t *create_checkpoint(cache_t *cache) {
 void display_set(cache_t *cache, unsigned int set_index) {
     unsigned int S = (unsigned int) cache->C / (cache->A * cache->B);
     if (set_index < S) {
-        cache_set_t *set = &cache->sets[set_index];
+        size_t first = (size_t) set_index * cache->A;
         for (unsigned int i = 0; i < cache->A; i++) {
-            printf ("Valid: %d Tag: %llx Lru: %lld Dirty: %d\n", set->lines[i].valid, 
-                set->lines[i].tag, set->lines[i].lru, set->lines[i].dirty);
+            bool valid = cache->tags[first + i] != TAG_INVALID;
+            printf ("Valid: %d Tag: %llx Dirty: %d\n", valid, 
+                valid ? cache->tags[first + i] : 0, cache->lines[first + i].dirty);
         }
     } else {
         printf ("Invalid Set %d. 0 <= Set < %d\n", set_index, S);
@@ -120,14 +487,8 @@ void display_set(cache_t *cache, unsigned int set_index) {
  * Free allocated memory. Feel free to modify it
  */
 void free_cache(cache_t *cache) {
-    unsigned int S = (unsigned int) cache->C / (cache->A * cache->B);
-    for (unsigned int i = 0; i < S; i++){
-        for (unsigned int j = 0; j < cache->A; j++) {
-            free(cache->sets[i].lines[j].data);
-        }
-        free(cache->sets[i].lines);
-    }
-    free(cache->sets);
+    free(cache->data);
+    free(cache->tags);
     free(cache);
 }
 
@@ -137,40 +498,14 @@ void free_cache(cache_t *cache) {
  * On miss, returns NULL
  */
 cache_line_t *get_line(cache_t *cache, uword_t addr) {
-    // Student TODO
-  // unsigned int S = (unsigned int) cache->C / (cache->A * cache->B);
-  // if (next_lru == __INT64_MAX__) {
-  //     for (unsigned int i = 0; i < S; i++){
-  //         for (unsigned int j = 0; j < cache->A; j++) {
-  //             cache->sets[i].lines[j].lru = 0;
-  //         }
-  //         free(cache->sets[i].lines);
-  //     }
-  //     next_lru = 1;
-  // }
-    
-    
-    unsigned int memBlockSize_b = _log(cache->B);
-    unsigned int setCount = (unsigned int) cache->C / (cache->A * cache->B);
-    unsigned int numSetBits_s = _log(setCount);
-
-    uword_t tag = bitfield_u64(addr, memBlockSize_b + numSetBits_s, ADDRESS_LENGTH - memBlockSize_b - numSetBits_s);
-    uword_t setIndex = bitfield_u64(addr, memBlockSize_b, numSetBits_s);
-  //  uword_t offset = bitfield_u64(addr, 0, memBlockSize_b);
-   // cache_set_t currentSet = cache->sets[setIndex];
+    // The sets' tags and lines are contiguous, so index them directly.
+    size_t first = ((addr >> cache->b) & cache->set_mask) * cache->A;
+    int way = cache->find_way(cache->tags + first, addr >> (cache->b + cache->s), cache->A);
 
-    for (unsigned int j = 0; j < cache->A; j++) {
-        uword_t currentTag = cache->sets[setIndex].lines[j].tag;
-
-        if (currentTag == tag && cache->sets[setIndex].lines[j].valid) {
-            // Hit occurred
-            next_lru++;
-            return &cache->sets[setIndex].lines[j];
-        }
+    if (way < 0) {
+        return NULL;
     }
-
-    // No hits = Miss, return NULL
-    return NULL;
+    return &cache->lines[first + way];
 }
 
 /* STUDENT TO-DO:
@@ -178,45 +513,21 @@ cache_line_t *get_line(cache_t *cache, uword_t addr) {
  * Return the cache line selected to filled in by addr
  */
 cache_line_t *select_line(cache_t *cache, uword_t addr) {
-    // Student TODO
-
-    // Loop through the cache set for this address by getting the tag
-    // If the tag is different (a new block) and the block is invalid (don't want to overwrite valid values yet) then replace
-    // Else if we didn't find any open spots, need to replace based on LRU policy
+    size_t first = ((addr >> cache->b) & cache->set_mask) * cache->A;
+    uint64_t *state = set_state(cache, first);
 
-    unsigned int memBlockSize_b = _log(cache->B);
-    unsigned int setCount = (unsigned int) cache->C / (cache->A * cache->B);
-    unsigned int numSetBits_s = _log(setCount);
-
-  //  uword_t tag = bitfield_u64(addr, memBlockSize_b + numSetBits_s, ADDRESS_LENGTH - memBlockSize_b - numSetBits_s);
-    uword_t setIndex = bitfield_u64(addr, memBlockSize_b, numSetBits_s);
-  
-
-    for (unsigned int j = 0; j < cache->A; j++) {
-     //   uword_t currentTag = cache->sets[setIndex].lines[j].tag;
-        bool validBit = cache->sets[setIndex].lines[j].valid;
-
-        // if valid == false
-        if (!validBit) {
-            return &cache->sets[setIndex].lines[j];
-        }
-    }
-
-    // Since we have reached here, need to find LRU block
-    int min = INT_MAX;
-    for (unsigned int j = 0; j < cache->A; j++) {
-        uword_t lru = cache->sets[setIndex].lines[j].lru;
-        if (lru <= min) {
-            min = lru;
-        }
+    // The first invalid line, or else the one the policy picks. Until a set
+    // is full for the first time its ways fill in order.
+    if (state[0] < cache->A) {
+        return &cache->lines[first + cache->find_way(cache->tags + first, TAG_INVALID, cache->A)];
     }
+    return &cache->lines[first + cache->repl->victim(cache, state + 1)];
+}
 
-    for (unsigned int j = 0; j < cache->A; j++) {
-        if (cache->sets[setIndex].lines[j].lru <= min) {
-            return &cache->sets[setIndex].lines[j];
-        }
-    }
-    return NULL;
+// Tell the policy a line was used again.
+static void touch_line(cache_t *cache, cache_line_t *line) {
+    size_t index = line - cache->lines;
+    cache->repl->touch(cache, set_state(cache, index) + 1, index % cache->A);
 }
 
 /*  STUDENT TO-DO:
@@ -229,94 +540,122 @@ bool check_hit(cache_t *cache, uword_t addr, operation_t operation) {
     
     // if the address is a miss 
     if (!cacheLineTemp) {
-        miss_count++;
+        cache->miss_count++;
         return false;
     }
     
-    hit_count++;
-    cacheLineTemp->lru = next_lru;
+    cache->hit_count++;
+    touch_line(cache, cacheLineTemp);
    if (operation == WRITE) {
        cacheLineTemp->dirty = true;
    }
    
-    // Next: need to updates the LRU information and the "dirty" status depending on the operation_t operation
+    // Next: need to updates the replacement information and the "dirty" status depending on the operation_t operation
     return true;
 }
 
-/*  STUDENT TO-DO:
- *  Handles Misses, evicting from the cache if necessary.
- *  Fill out the evicted_line_t struct with info regarding the evicted line.
+/*
+ * Replace the line addr maps to, without allocating anything.
+ * Describes the line being replaced in *evicted and installs addr's tag in its place.
+ * evicted->data points at the line's own buffer, which still holds the old contents:
+ * write it back if needed before filling the returned line with the new block.
  */
-evicted_line_t *handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data) {
-    
-    evicted_line_t *evicted_line = malloc(sizeof(evicted_line_t));
-    evicted_line->data = (byte_t *) calloc(cache->B, sizeof(byte_t));
-    
-
+cache_line_t *replace_line(cache_t *cache, uword_t addr, operation_t operation, evicted_line_t *evicted) {
     cache_line_t* selected = select_line(cache, addr);
+    uword_t setIndex = (addr >> cache->b) & cache->set_mask;
+    uword_t *tag = &cache->tags[selected - cache->lines];
+    bool valid = *tag != TAG_INVALID;
     
-    unsigned int memBlockSize_b = _log(cache->B);
-    unsigned int setCount = (unsigned int) cache->C / (cache->A * cache->B);
-    unsigned int numSetBits_s = _log(setCount);
-    uword_t setIndex = bitfield_u64(addr, memBlockSize_b, numSetBits_s);
-    
-    
-    if (selected->valid) {
+    if (valid) {
         if (selected->dirty) {
-            dirty_eviction_count++;
+            cache->dirty_eviction_count++;
         }
         else {
-            clean_eviction_count++;
+            cache->clean_eviction_count++;
         }
     }
 
+    evicted->addr = ((valid ? *tag : 0) << (cache->b + cache->s) | (setIndex << cache->b));
+    evicted->data = line_data(cache, selected);
+    evicted->dirty = selected->dirty;
+    evicted->prefetched = valid && selected->prefetched;
+    evicted->valid = valid;
     
-    //uword_t offset = bitfield_u64(addr, 0, memBlockSize_b);
-    evicted_line->addr = (selected->tag << (memBlockSize_b + numSetBits_s) | (setIndex << memBlockSize_b));
-    if (selected->data) {
-        memcpy(evicted_line->data, selected->data, cache->B);
-    }
-  //else {
-  //    memset(evicted_line->data, 0, cache->B);
-  //}
-    
-   
-    evicted_line->dirty = selected->dirty;
-    evicted_line->valid = selected->valid;
-    
-    if (incoming_data) {
-        memcpy(selected->data, incoming_data, cache->B);
-    }
-    //else {
-    //    memset(selected->data, 0, cache->B);
-    //}
-    
-   // selected.
     selected->dirty = operation == WRITE;
-    selected->valid = true;
-    selected->tag = bitfield_u64(addr, memBlockSize_b + numSetBits_s, ADDRESS_LENGTH - memBlockSize_b - numSetBits_s);
+    selected->prefetched = false;
+    *tag = addr >> (cache->b + cache->s);
     
-    selected->lru = next_lru++;
+    size_t index = selected - cache->lines;
+    uint64_t *state = set_state(cache, index);
+    if (!valid) {
+        state[0]++;
+    }
+    cache->repl->insert(cache, state + 1, index % cache->A);
     
-  
-    return evicted_line;
+    return selected;
+}
+
+/*
+ * Remove the line holding addr, if any, for a lower level that must not keep
+ * lines its upper levels lack, or the reverse. Describes the line in *evicted
+ * as replace_line would; the caller writes back its data if it was dirty.
+ * Returns false if addr was not in the cache.
+ */
+bool invalidate_line(cache_t *cache, uword_t addr, evicted_line_t *evicted) {
+    cache_line_t *line = get_line(cache, addr);
+    if (!line) {
+        return false;
+    }
+    size_t index = line - cache->lines;
+    evicted->addr = addr & ~(uword_t) (cache->B - 1);
+    evicted->data = line_data(cache, line);
+    evicted->dirty = line->dirty;
+    evicted->prefetched = line->prefetched;
+    evicted->valid = true;
+    cache->tags[index] = TAG_INVALID;
+    line->dirty = false;
+    line->prefetched = false;
+    set_state(cache, index)[0]--;
+    return true;
+}
+
+/*  STUDENT TO-DO:
+ *  Handles Misses, evicting from the cache if necessary.
+ *  Fills out *evicted with info regarding the evicted line, as replace_line
+ *  does, then fills the line in place with incoming_data, if not NULL.
+ *  Filling overwrites the old contents, so they are first copied to old_data,
+ *  B bytes the caller owns, and evicted->data then points there (or is NULL
+ *  if old_data is). Nothing is allocated. Returns the line filled.
+ */
+cache_line_t *handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data,
+                          evicted_line_t *evicted, byte_t *old_data) {
+    cache_line_t *selected = replace_line(cache, addr, operation, evicted);
+
+    if (incoming_data && cache->data) {
+        if (old_data) {
+            memcpy(old_data, evicted->data, cache->B);
+        }
+        evicted->data = old_data;
+        memcpy(line_data(cache, selected), incoming_data, cache->B);
+    }
+    return selected;
 }
 
 /* STUDENT TO-DO:
  * Get 8 bytes from the cache and write it to dest.
  * Preconditon: addr is contained within the cache.
+ * The lookup that brought addr in already updated the replacement state.
  */
 void get_word_cache(cache_t *cache, uword_t addr, word_t *dest) {
     // Student TODO
 
-    unsigned int memBlockSize_b = _log(cache->B);
-    uword_t offset = bitfield_u64(addr, 0, memBlockSize_b);
+    uword_t offset = addr & (cache->B - 1);
     cache_line_t *line_ptr = get_line(cache, addr);
     
-    byte_t* bytePointer = (line_ptr->data) + offset;
   //  if (offset + sizeof(word_t) <= cache->B) {
-    line_ptr->lru = next_lru;
-    memcpy(dest, bytePointer, sizeof(word_t));
+    if (cache->data) {
+        memcpy(dest, line_data(cache, line_ptr) + offset, sizeof(word_t));
+    }
   //  }
 }
 
@@ -326,14 +665,13 @@ void get_word_cache(cache_t *cache, uword_t addr, word_t *dest) {
  */
 void set_word_cache(cache_t *cache, uword_t addr, word_t val) {
 
-    unsigned int memBlockSize_b = _log(cache->B);
-    uword_t offset = bitfield_u64(addr, 0, memBlockSize_b);
+    uword_t offset = addr & (cache->B - 1);
     
     cache_line_t *line_ptr = get_line(cache, addr);
-    byte_t* bytePointer = (line_ptr->data) + offset;
 
-    line_ptr->lru = next_lru;
-    memcpy(bytePointer, &val, sizeof(word_t));  
+    if (cache->data) {
+        memcpy(line_data(cache, line_ptr) + offset, &val, sizeof(word_t));
+    }
     line_ptr->dirty = true;  
     
 }
@@ -349,8 +687,10 @@ void set_word_cache(cache_t *cache, uword_t addr, word_t val) {
  */
 void access_data(cache_t *cache, uword_t addr, operation_t operation)
 {
+    evicted_line_t evicted;
+
     if(!check_hit(cache, addr, operation))
-        free(handle_miss(cache, addr, operation, NULL));
+        handle_miss(cache, addr, operation, NULL, &evicted, NULL);
 }
 
 uword_t bitfield_u64(uword_t src, unsigned frompos, unsigned width) {
@@ -5,8 +5,10 @@
  * 
  * csim.c - A testbench for the cache simulator that can replay traces
  *     and output statistics such as number of hits, misses, and
- *     evictions, both dirty and clean.  The replacement policy is LRU. 
- *     The cache is a writeback cache. 
+ *     evictions, both dirty and clean.  The replacement policy is LRU
+ *     unless -r picks another.  The cache is a writeback cache. 
+ *     With -M it instead prints the LRU hits and misses of every
+ *     capacity, and of every associativity for -S sets, from one replay.
  * 
  * Copyright (c) 2021, 2023, 2024, 2025. 
  * Authors: M. Hinton, Z. Leeper.
@@ -30,12 +32,6 @@ char* trace_file = NULL;
 
 int verbosity_cache = 0;
 
-/* Counters used to record cache statistics */
-extern int miss_count;
-extern int hit_count;
-extern int dirty_eviction_count;
-extern int clean_eviction_count;
-
 /*
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded.
@@ -95,24 +91,274 @@ void replayTrace(cache_t *cache, char* trace_fn)
     fclose(trace_fp);
 }
 
+/*
+ * -M replays the trace once and works out every access's LRU stack distance:
+ * the number of other lines accessed since the last access to its line. An
+ * LRU cache of k lines hits exactly the accesses whose distance is below k
+ * (Mattson et al., 1970), so a histogram of the distances gives the hits of
+ * every fully associative capacity at once. Counting only the lines of the
+ * access's own set does the same for every associativity with -S sets.
+ *
+ * The lines are kept in splay trees in the order of their last access, most
+ * recent last, so a line's distance is the size of its right subtree once it
+ * has been splayed to the root. Every line is in two trees: one of all the
+ * lines, and one of the lines in its set.
+ */
+typedef struct stackNode {
+    struct stackNode *left, *right, *parent;
+    unsigned long size;     /* Nodes in this subtree */
+} stackNode_t;
+
+typedef struct lineEntry {
+    uword_t line;
+    struct lineEntry *next; /* Next line in the same hash bucket */
+    stackNode_t all, set;   /* The line in the tree of all lines and in its set's */
+} lineEntry_t;
+
+/* The distances seen so far: hist[d] accesses had distance d. */
+typedef struct stackHist {
+    unsigned long *hist;
+    unsigned long len;      /* Entries in hist, all distances seen are below it */
+    unsigned long cold;     /* First accesses to a line */
+} stackHist_t;
+
+static unsigned long nodeSize(stackNode_t *x)
+{
+    return x ? x->size : 0;
+}
+
+/* Move x above its parent, keeping the order of the nodes. */
+static void rotate(stackNode_t *x)
+{
+    stackNode_t *p = x->parent, *g = p->parent;
+
+    if (p->left == x) {
+        p->left = x->right;
+        if (x->right)
+            x->right->parent = p;
+        x->right = p;
+    } else {
+        p->right = x->left;
+        if (x->left)
+            x->left->parent = p;
+        x->left = p;
+    }
+    p->parent = x;
+    x->parent = g;
+    if (g) {
+        if (g->left == p)
+            g->left = x;
+        else
+            g->right = x;
+    }
+    p->size = 1 + nodeSize(p->left) + nodeSize(p->right);
+    x->size = 1 + nodeSize(x->left) + nodeSize(x->right);
+}
+
+static void splay(stackNode_t *x)
+{
+    while (x->parent) {
+        stackNode_t *p = x->parent, *g = p->parent;
+        if (g)
+            rotate((g->left == p) == (p->left == x) ? p : x);
+        rotate(x);
+    }
+}
+
+/*
+ * Record an access to x in the tree *root, whose most recent line it becomes,
+ * and return its stack distance, or -1 if it was not in the tree yet.
+ */
+static long touchLine(stackNode_t **root, stackNode_t *x, bool first)
+{
+    stackNode_t *older = *root;
+    long dist = -1;
+
+    if (!first) {
+        /* Take x out, joining the lines before and after it. */
+        splay(x);
+        dist = nodeSize(x->right);
+        older = x->left;
+        if (older) {
+            older->parent = NULL;
+            while (older->right)
+                older = older->right;
+            splay(older);
+            older->right = x->right;
+        } else {
+            older = x->right;
+        }
+        if (x->right)
+            x->right->parent = older;
+        if (older)
+            older->size = 1 + nodeSize(older->left) + nodeSize(older->right);
+    }
+    /* Everything else is older, so x becomes the root with all of it on its left. */
+    x->left = older;
+    x->right = x->parent = NULL;
+    if (older)
+        older->parent = x;
+    x->size = 1 + nodeSize(older);
+    *root = x;
+    return dist;
+}
+
+static void countDistance(stackHist_t *h, long dist)
+{
+    if (dist < 0) {
+        h->cold++;
+        return;
+    }
+    if ((unsigned long) dist >= h->len) {
+        unsigned long len = h->len ? h->len : 64;
+        while (len <= (unsigned long) dist)
+            len *= 2;
+        h->hist = realloc(h->hist, len * sizeof(unsigned long));
+        memset(h->hist + h->len, 0, (len - h->len) * sizeof(unsigned long));
+        h->len = len;
+    }
+    h->hist[dist]++;
+}
+
+/*
+ * Print the hits and misses of LRU caches of 1, 2, 4, ... lines per set (or
+ * every number of lines if verbose), up to one that holds every line of a set.
+ * S is 0 for a single, fully associative set.
+ */
+static void printCurve(stackHist_t *h, unsigned long maxLines, unsigned int S, unsigned int B)
+{
+    unsigned long hits = 0, total = h->cold, lines = 1, d = 0;
+
+    for (unsigned long i = 0; i < h->len; i++)
+        total += h->hist[i];
+    for (;;) {
+        for (; d < lines && d < h->len; d++)
+            hits += h->hist[d];
+        if (S)
+            printf("%lu,", lines);
+        printf("%lu,%lu,%lu\n", lines * (S ? S : 1) * B, hits, total - hits);
+        if (lines >= maxLines)
+            break;
+        lines = verbosity_cache ? lines + 1 : lines * 2;
+    }
+}
+
+/*
+ * replayStackDistances - replays the given trace file once and prints the
+ * LRU hits and misses of every capacity with B-byte lines and, if S is not
+ * 0, of every associativity with S sets
+ */
+void replayStackDistances(char* trace_fn, unsigned int B, unsigned int S)
+{
+    char buf[1000];
+    uword_t addr=0;
+    unsigned int len=0;
+    unsigned int b = __builtin_ctz(B);
+    unsigned long numBuckets = 1024, numLines = 0, maxSetLines = 0;
+    lineEntry_t **buckets = calloc(numBuckets, sizeof(lineEntry_t *));
+    stackNode_t *allRoot = NULL;
+    stackNode_t **setRoots = calloc(S ? S : 1, sizeof(stackNode_t *));
+    stackHist_t all = {0}, sets = {0};
+    FILE* trace_fp = fopen(trace_fn, "r");
+
+    if(!trace_fp){
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+
+    while( fgets(buf, 1000, trace_fp) != NULL) {
+        if(buf[1]!='S' && buf[1]!='L' && buf[1]!='M')
+            continue;
+        sscanf(buf+3, "%llx,%u", &addr, &len);
+
+        uword_t line = addr >> b;
+        lineEntry_t **bucket = &buckets[line & (numBuckets - 1)];
+        lineEntry_t *e;
+        for (e = *bucket; e && e->line != line; e = e->next)
+            ;
+        bool first = e == NULL;
+        if (first) {
+            e = calloc(1, sizeof(lineEntry_t));
+            e->line = line;
+            e->next = *bucket;
+            *bucket = e;
+            numLines++;
+        }
+        /* A modify is a load and then a store, which always hits. */
+        for (int i = 0; i < (buf[1] == 'M' ? 2 : 1); i++) {
+            countDistance(&all, touchLine(&allRoot, &e->all, first && i == 0));
+            if (S) {
+                stackNode_t **setRoot = &setRoots[line & (S - 1)];
+                countDistance(&sets, touchLine(setRoot, &e->set, first && i == 0));
+                if ((*setRoot)->size > maxSetLines)
+                    maxSetLines = (*setRoot)->size;
+            }
+        }
+
+        /* Keep about one line per bucket. */
+        if (numLines > numBuckets) {
+            lineEntry_t **old = buckets;
+            buckets = calloc(2 * numBuckets, sizeof(lineEntry_t *));
+            for (unsigned long i = 0; i < numBuckets; i++) {
+                while (old[i]) {
+                    lineEntry_t *next = old[i]->next;
+                    old[i]->next = buckets[old[i]->line & (2 * numBuckets - 1)];
+                    buckets[old[i]->line & (2 * numBuckets - 1)] = old[i];
+                    old[i] = next;
+                }
+            }
+            free(old);
+            numBuckets *= 2;
+        }
+    }
+    fclose(trace_fp);
+
+    printf("C,hits,misses\n");
+    printCurve(&all, numLines, 0, B);
+    if (S) {
+        printf("\nA,C,hits,misses\n");
+        printCurve(&sets, maxSetLines, S, B);
+    }
+
+    for (unsigned long i = 0; i < numBuckets; i++) {
+        while (buckets[i]) {
+            lineEntry_t *next = buckets[i]->next;
+            free(buckets[i]);
+            buckets[i] = next;
+        }
+    }
+    free(buckets);
+    free(setRoots);
+    free(all.hist);
+    free(sets.hist);
+}
+
 /*
  * printUsage - Print usage info
  */
 void printUsage(char* argv[])
 {
-    printf("Usage: %s [-hv] -A <num> -B <num> -C <num> -t <file>\n", argv[0]);
+    printf("Usage: %s [-hv] -A <num> -B <num> -C <num> [-r <name>] -t <file>\n", argv[0]);
+    printf("       %s [-v] -M -B <num> [-S <num>] -t <file>\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
     printf("  -A <num>   Number of lines per set.\n");
     printf("  -B <num>   Number of bytes per block. Must be >= 8 and a power of 2.\n");
     printf("  -C <num>   Number of bytes in the cache. \n");
+    printf("  -r <name>  Replacement policy: lru (the default), plru, nru, srrip, brrip or random.\n");
     // printf("  -E <num>   Number of lines per set.\n");
     // printf("  -b <num>   Number of block offset bits.\n");
     printf("  -t <file>  Trace file.\n");
+    printf("  -M         Miss curves. Replay the trace once and print the hits and misses of a fully associative\n");
+    printf("             LRU cache of every power of 2 of lines (every number of lines with -v), up to one that\n");
+    printf("             holds them all. -A, -C and -r are ignored.\n");
+    printf("  -S <num>   Sets. With -M, also print the hits and misses of an LRU cache with <num> sets (a power\n");
+    printf("             of 2) for every power of 2 of lines per set (every number of them with -v).\n");
     printf("\nExamples:\n");
     printf("  linux>  %s -A 1 -B 16 -C 64 -t testcases/cache/yi.trace\n", argv[0]);
     printf("  linux>  %s -v -A 2 -B 16 -C 256 -t testcases/cache/yi.trace\n", argv[0]);
+    printf("  linux>  %s -M -B 16 -S 4 -t testcases/cache/yi.trace\n", argv[0]);
     exit(0);
 }
 
@@ -121,9 +367,11 @@ void printUsage(char* argv[])
  */
 int main(int argc, char* argv[])
 {
-    int A = -1, B = -1, C = -1;
+    int A = -1, B = -1, C = -1, S = 0;
+    bool curves = false;
+    replacement_t policy = REPL_LRU;
     char c;
-    while( (c=getopt(argc,argv,"A:B:C:t:vh")) != -1){
+    while( (c=getopt(argc,argv,"A:B:C:r:t:MS:vh")) != -1){
         switch(c){
         case 'A':
             A = atoi(optarg);
@@ -140,9 +388,27 @@ int main(int argc, char* argv[])
         case 'C':
             C = atoi(optarg);
             break;
+        case 'r':
+            if (!parse_replacement(optarg, &policy)) {
+                printf("Replacement policy invalid. Refer to usage:\n");
+                printUsage(argv);
+                exit(1);
+            }
+            break;
         case 't':
             trace_file = optarg;
             break;
+        case 'M':
+            curves = true;
+            break;
+        case 'S':
+            S = atoi(optarg);
+            if (S < 1 || __builtin_popcountll(S) != 1) {
+                printf("Number of sets invalid. Refer to usage:\n");
+                printUsage(argv);
+                exit(1);
+            }
+            break;
         case 'v':
              verbosity_cache = 1;
             break;
@@ -155,6 +421,16 @@ int main(int argc, char* argv[])
         }
     }
 
+    if (curves) {
+        if (B == -1 || trace_file == NULL) {
+            printf("%s: Missing required command line argument\n", argv[0]);
+            printUsage(argv);
+            exit(1);
+        }
+        replayStackDistances(trace_file, B, S);
+        return 0;
+    }
+
     /* Make sure that all required command line args were specified */
     if (A == -1 || B == -1 || C == -1 || trace_file == NULL) {
         printf("%s: Missing required command line argument\n", argv[0]);
@@ -168,7 +444,7 @@ int main(int argc, char* argv[])
     }
 
     /* Initialize cache */
-    cache_t *cache = create_cache(A, B, C, 0);
+    cache_t *cache = create_cache_policy(A, B, C, 0, policy, false);
 
 #ifdef DEBUG_ON
     printf("DEBUG: A:%u B:%u C:%u trace:%s\n", A, B, C, trace_file);
@@ -177,10 +453,11 @@ int main(int argc, char* argv[])
 
     replayTrace(cache, trace_file);
 
+    /* Output the hit and miss statistics for the autograder */
+    printSummary(cache->hit_count, cache->miss_count,
+                 cache->dirty_eviction_count, cache->clean_eviction_count);
+
     /* Free allocated memory */
     free_cache(cache);
-
-    /* Output the hit and miss statistics for the autograder */
-    printSummary(hit_count, miss_count, dirty_eviction_count, clean_eviction_count);
     return 0;
 }
@@ -15,8 +15,6 @@
 #include "hazard_control.h"
 #include "machine.h"
  
-extern machine_t guest;
-extern mem_status_t dmem_status;
  
 /* Use this method to actually bubble/stall a pipeline stage.
  * Call it in handle_hazards(). Do not modify this code. */
@@ -120,7 +118,7 @@ comb_logic_t handle_hazards(opcode_t D_opcode , uint8_t D_src1, uint8_t D_src2,
  bool memError =    error(W_in->status);
  bool wbError =     error(W_out->status);
  bool memFlightError = false;
- if (dmem_status == IN_FLIGHT) {
+ if (cur_guest->dmem_status == IN_FLIGHT) {
  // dmem_status =
   memFlightError = true;
  }
@@ -12,18 +12,16 @@
 #include "forward.h"
 #include "machine.h"
 #include "hw_elts.h"
+#include "predecode.h"
 
 #include "pthread.h"
 
 #define SP_NUM 31
 #define XZR_NUM 32
 
-extern machine_t guest;
-extern mem_status_t dmem_status;
 extern pthread_barrier_t cycle_end;
 extern pthread_barrier_t latch_end;
 
-extern int64_t W_wval;
 //set wwval in write back based on what value (val x or valm), set as parameter in decode
 /*
    * Control signals for D, X, M, and W stages.
@@ -34,7 +32,7 @@ extern int64_t W_wval;
    * Generate the correct control signals for this instruction's
    * future stages and write them to the corresponding struct.
    */
-static comb_logic_t generate_DXMW_control(opcode_t op,
+comb_logic_t generate_DXMW_control(opcode_t op,
 	x_ctl_sigs_t* X_sigs,
 	m_ctl_sigs_t* M_sigs,
 	w_ctl_sigs_t* W_sigs) {
@@ -64,7 +62,7 @@ static comb_logic_t generate_DXMW_control(opcode_t op,
    * STUDENT TO-DO:
    * Extract the immediate value and write it to *imm.
    */
-static comb_logic_t extract_immval(uint32_t insnbits, opcode_t op,
+comb_logic_t extract_immval(uint32_t insnbits, opcode_t op,
 	int64_t* imm) {
 	
 	switch (op) {
@@ -115,7 +113,7 @@ static comb_logic_t extract_immval(uint32_t insnbits, opcode_t op,
    * Determine the ALU operation based on the given opcode
    * and write it to *ALU_op.
    */
-static comb_logic_t decide_alu_op(opcode_t op, alu_op_t* ALU_op) {
+comb_logic_t decide_alu_op(opcode_t op, alu_op_t* ALU_op) {
 	// Student TODO
 
 	
@@ -270,20 +268,29 @@ comb_logic_t extract_regs(uint32_t insnbits, opcode_t op, uint8_t* src1,
 
 comb_logic_t decode_instr(d_instr_impl_t* in, x_instr_impl_t* out) {
 	
-	generate_DXMW_control(in->op, &out->X_sigs, &out->M_sigs, &out->W_sigs);
-	uint8_t src1 = 0;
-	uint8_t src2 = 0;
-	uint8_t dst = 0; 
+	// Reuse the fields Fetch predecoded for this PC, or decode them now
+	// (bubbles, generated HLTs and entries evicted since fetch).
+	decoded_insn_t decoded;
+	const decoded_insn_t* di = predecode_lookup(in->this_PC, in->insnbits, in->op);
+	if (!di) {
+		decode_fields(in->insnbits, in->op, &decoded);
+		di = &decoded;
+	}
+
+	out->X_sigs = di->X_sigs;
+	out->M_sigs = di->M_sigs;
+	out->W_sigs = di->W_sigs;
+	uint8_t src1 = di->src1;
+	uint8_t src2 = di->src2;
+	uint8_t dst = di->dst; 
 	uint64_t vala = 0;
 	uint64_t valb = 0;
 	
 	bool dst_sel = out->W_sigs.dst_sel;
-	alu_op_t tempOp = ERROR_OP;
-	extract_regs(in->insnbits, in->op, &src1, &src2, &dst);
-	decide_alu_op(in->op, &tempOp);
+	alu_op_t tempOp = di->ALU_op;
 	// On stur/ldur, vala becomes the base address to store/load at 
 	
-	regfile(src1, src2, dst, W_wval, dst_sel, &vala, &valb);
+	regfile(src1, src2, dst, cur_guest->W_wval, dst_sel, &vala, &valb);
 
 	// TODO: Fix bl_ret
 				
@@ -298,7 +305,7 @@ comb_logic_t decode_instr(d_instr_impl_t* in, x_instr_impl_t* out) {
 	out->val_hw = 0;
 
 	if (in->op == OP_MOVK) {
-		out->val_a = guest.proc->GPR[dst];
+		out->val_a = cur_guest->proc->GPR[dst];
 	}
 	uint8_t forwardDest = 0;
 	uint8_t forwardSource = 0;
@@ -321,7 +328,7 @@ comb_logic_t decode_instr(d_instr_impl_t* in, x_instr_impl_t* out) {
 		out->val_imm = src2;
 	//	if (in->op == OP_LDUR) {
 		if (dst != XZR_NUM) {
-			out->val_b = guest.proc->GPR[dst];
+			out->val_b = cur_guest->proc->GPR[dst];
 		}
 		else {
 			out->val_b = 0;;
@@ -331,7 +338,7 @@ comb_logic_t decode_instr(d_instr_impl_t* in, x_instr_impl_t* out) {
 	if (in->op == OP_RET) {
 		uint32_t regForReturn = bitfield_u32(in->insnbits, 5, 5);
 		forwardDest = regForReturn;
-		out->val_a = guest.proc->GPR[regForReturn];
+		out->val_a = cur_guest->proc->GPR[regForReturn];
 	}
 	
 
@@ -354,7 +361,7 @@ comb_logic_t decode_instr(d_instr_impl_t* in, x_instr_impl_t* out) {
 		|| in->op == OP_LSL || in->op == OP_LSR || in->op == OP_ASR 
 		|| in->op == OP_MOVZ || in->op == OP_MOVK) {
 
-		extract_immval(in->insnbits, in->op, &out->val_imm);
+		out->val_imm = di->imm;
 	}
 
 	if (in->op == OP_B_COND) {
@@ -364,7 +371,7 @@ comb_logic_t decode_instr(d_instr_impl_t* in, x_instr_impl_t* out) {
 		uint32_t shiftVal = bitfield_u32(in->insnbits, 21, 2) * 16;
 		out->val_hw = shiftVal;
 		if (in->op == OP_MOVK) {
-			//out->val_a = guest.proc->GPR[dst];
+			//out->val_a = cur_guest->proc->GPR[dst];
 			uint64_t mask = ~(0xFFFFULL << shiftVal);
 			out->val_a = out->val_a & mask;
 		}
@@ -381,11 +388,12 @@ comb_logic_t decode_instr(d_instr_impl_t* in, x_instr_impl_t* out) {
 	}
 	
 	else if (in->op == OP_ADRP) {
-		extract_immval(in->insnbits, in->op, &out->val_imm);
+		out->val_imm = di->imm;
 		out->val_a = in->multipurpose_val.adrp_val;
 		out->val_b = 0;
 	}
 	 
 
+	out->this_PC = in->this_PC;
 	out->seq_succ_PC = in->op != OP_ADRP ? in->multipurpose_val.seq_succ_PC : in->multipurpose_val.adrp_val;
 }
@@ -12,8 +12,6 @@
  #include "machine.h"
  #include "hw_elts.h"
  
- extern machine_t guest;
- extern mem_status_t dmem_status;
  
  extern comb_logic_t copy_m_ctl_sigs(m_ctl_sigs_t *, m_ctl_sigs_t *);
  extern comb_logic_t copy_w_ctl_sigs(w_ctl_sigs_t *, w_ctl_sigs_t *);
@@ -53,7 +51,7 @@
 	 cond_t condition = in->cond;
 	 uint64_t outputValue = 0;
 	 bool conditionValue = true;
-	 uint8_t nzcv = guest.proc->NZCV;
+	 uint8_t nzcv = cur_guest->proc->NZCV;
 
 	bool setFlags = in->X_sigs.set_flags;
 	if (in->op != OP_NOP && in->op != OP_HLT) {
@@ -67,7 +65,7 @@
 	
 
 	if (setFlags) {
-		guest.proc->NZCV = nzcv;
+		cur_guest->proc->NZCV = nzcv;
 	}
 	
 	out->dst = in->dst;
@@ -80,6 +78,7 @@
 	if (in->op == OP_BL) {
 		out->val_ex = in->seq_succ_PC;
 	}
+	out->this_PC = in->this_PC;
 	out->seq_succ_PC = in->seq_succ_PC;
 	copy_m_ctl_sigs(&out->M_sigs, &in->M_sigs);
 	copy_w_ctl_sigs(&out->W_sigs, &in->W_sigs);
@@ -8,12 +8,12 @@
 #include "instr.h"
 #include "instr_pipeline.h"
 #include "machine.h"
+#include "predecode.h"
 #include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
-extern machine_t guest;
-extern mem_status_t dmem_status;
 
 /*
  * Select PC logic.
@@ -75,7 +75,7 @@ static comb_logic_t predict_PC(uint64_t current_PC, uint32_t insnbits,
       break;
     case OP_BL:
       offset = bitfield_s64(insnbits, 0, 26) * 4;
-     // guest.proc->GPR[30] = current_PC + 4;
+     // cur_guest->proc->GPR[30] = current_PC + 4;
       break;
     case OP_B_COND:
       offset = bitfield_s64(insnbits, 5, 19) * 4;
@@ -94,7 +94,7 @@ static comb_logic_t predict_PC(uint64_t current_PC, uint32_t insnbits,
  * STUDENT TO-DO
  */
 
-static void fix_instr_aliases(uint32_t insnbits, opcode_t *op) {
+void fix_instr_aliases(uint32_t insnbits, opcode_t *op) {
 
   uint32_t opCodeBits = bitfield_u32(insnbits, 21, 11);
   opcode_t resultOp = itable[opCodeBits];
@@ -172,18 +172,24 @@ comb_logic_t fetch_instr(f_instr_impl_t *in, d_instr_impl_t *out) {
   } else {
     uint32_t instruction = 0;    
 
-    // Get instruction from current PC
-    imem(current_PC, &instruction, &imem_err);
+    // Until an instruction cache miss is served, fetch this PC again and
+    // send a bubble down the pipe.
+    if (!mem_ifetch(cur_guest, current_PC)) {
+      cur_guest->proc->PC = current_PC;
+      memset(out, 0, sizeof(*out));
+      return;
+    }
 
-    // currentOp is bitfield_u32(instruction, 21, 11)
-    opcode_t resultOp = itable[bitfield_u32(instruction, 21, 11)];
-    fix_instr_aliases(instruction, &resultOp);
+    // Get instruction from current PC, decoding it on first fetch
+    const decoded_insn_t *di = predecode(current_PC, &imem_err);
+    instruction = di->insnbits;
+    opcode_t resultOp = di->op;
 
     uint64_t predictedPCVar = 0;
 
     // Get predicted PC value, set seq_succ and the current pc
     predict_PC(current_PC, instruction, resultOp, &predictedPCVar, &out->multipurpose_val.seq_succ_PC);
-    guest.proc->PC = predictedPCVar;   
+    cur_guest->proc->PC = predictedPCVar;   
     out->op = resultOp;
     out->insnbits = instruction;
     out->print_op = resultOp;
@@ -193,6 +199,8 @@ comb_logic_t fetch_instr(f_instr_impl_t *in, d_instr_impl_t *out) {
     }
   }
 
+  out->this_PC = current_PC;
+
   if (imem_err || out->op == OP_ERROR) {
     in->status = STAT_INS;
     F_in->status = in->status;
@@ -16,8 +16,6 @@
 #include "machine.h"
 #include "hw_elts.h"
 
-extern machine_t guest;
-extern mem_status_t dmem_status;
 
 extern comb_logic_t copy_w_ctl_sigs(w_ctl_sigs_t *, w_ctl_sigs_t *);
 
@@ -37,6 +35,7 @@ comb_logic_t memory_instr(m_instr_impl_t *in, w_instr_impl_t *out) {
   
     bool dmemError = false;
     if (in->M_sigs.dmem_write || in->M_sigs.dmem_read) {
+        cur_guest->dmem_PC = in->this_PC;
         dmem(in->val_ex, in->val_b, in->M_sigs.dmem_read, in->M_sigs.dmem_write, &out->val_mem, &dmemError);
     }
 
@@ -18,10 +18,7 @@
 
 #define SP_NUM 31
 #define XZR_NUM 32
-extern machine_t guest;
-extern mem_status_t dmem_status;
 
-extern int64_t W_wval;
 
 /*
 * Write-back stage logic.
@@ -30,21 +27,21 @@ extern int64_t W_wval;
 * 
 * Use in as the input pipeline register.
 * 
-* You will need the global variable W_wval.
+* You will need cur_guest->W_wval.
 */
 comb_logic_t wback_instr(w_instr_impl_t *in) {
 
-    W_wval = in->val_ex;
+    cur_guest->W_wval = in->val_ex;
     if (in->op == OP_BL) {
-      guest.proc->GPR[30] = W_wval;
+      cur_guest->proc->GPR[30] = cur_guest->W_wval;
     }
     else if (in->W_sigs.w_enable) {
      
         if (in->dst < SP_NUM) {
-          guest.proc->GPR[in->dst] = W_wval;
+          cur_guest->proc->GPR[in->dst] = cur_guest->W_wval;
         }
         else if (in->dst == SP_NUM) {
-          guest.proc->SP = W_wval;
+          cur_guest->proc->SP = cur_guest->W_wval;
         }
     }
   //  else if (in->op != OP_NOP && in->op != OP_HLT
@@ -55,20 +52,20 @@ comb_logic_t wback_instr(w_instr_impl_t *in) {
   //       in->op != OP_STUR) {
   //    
   //      if (in->dst < SP_NUM) {
-  //        guest.proc->GPR[in->dst] = in->val_ex;
+  //        cur_guest->proc->GPR[in->dst] = in->val_ex;
   //      }
   //      else if (in->dst == SP_NUM) {
-  //        guest.proc->SP = in->val_ex;
+  //        cur_guest->proc->SP = in->val_ex;
   //      }
   //      
   //  }
      if (in->op == OP_LDUR) {
       if (in->dst < SP_NUM) {
-        guest.proc->GPR[in->dst] = in->val_mem;  
+        cur_guest->proc->GPR[in->dst] = in->val_mem;  
       }
       else if (in->dst == SP_NUM) {
-        guest.proc->SP = in->val_mem;
+        cur_guest->proc->SP = in->val_mem;
       }
-      W_wval = in->val_mem;
+      cur_guest->W_wval = in->val_mem;
     }
 }
\ No newline at end of file
@@ -26,12 +26,9 @@
  #include "hw_elts.h"
  
  
- extern machine_t guest;
- extern mem_status_t dmem_status;
  
  
  uint64_t F_PC;
- int64_t W_wval;
  
  /*
   * Extracts the bitfield src[frompos+width-1:frompos] and returns it
@@ -239,7 +236,7 @@
         }
         printf("F: %-6s[PC, insn_bits] = [%08lX,  %08X], seq_succ_PC: 0x%lX, pred_PC: 0x%lX, adrp_val: 0x%lX, status: %s\n", 
             D_in->print_op != OP_ERROR ? opcode_names[D_in->print_op] : "ERR",
-            guest.proc->PC, 
+            cur_guest->proc->PC, 
             D_in->insnbits,
             seq_succ_PC,
             F_in->pred_PC,
@@ -387,7 +384,7 @@
                 W_out->W_sigs.dst_sel ? "true " : "false",
                 W_out->W_sigs.wval_sel ? "true " : "false",
                 W_out->W_sigs.w_enable ? "true" : "false",
-                W_wval);
+                cur_guest->W_wval);
             break;
         default: IMPOSSIBLE(); break;
     }
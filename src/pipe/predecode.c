@@ -0,0 +1,80 @@
+/**************************************************************************
+ * C S 429 system emulator
+ *
+ * predecode.c - Predecoded instruction cache shared by Fetch and Decode.
+ *
+ * The cache is direct-mapped on the word address of the instruction and
+ * tagged with the full PC. A fill reads the instruction through imem and
+ * runs the same helpers Fetch and Decode use, so a hit is indistinguishable
+ * from decoding the bits again.
+ *
+ * Copyright (c) 2025.
+ * All rights reserved.
+ * May not be used, modified, or copied without permission.
+ **************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "instr.h"
+#include "instr_pipeline.h"
+#include "hw_elts.h"
+#include "predecode.h"
+#include "machine.h"
+
+static inline decoded_insn_t *dcache_entry(decoded_insn_t *dcache, uint64_t PC) {
+    return &dcache[(PC >> 2) & (PREDECODE_SIZE - 1)];
+}
+
+void decode_fields(uint32_t insnbits, opcode_t op, decoded_insn_t *di) {
+    di->insnbits = insnbits;
+    di->op = op;
+    di->src1 = 0;
+    di->src2 = 0;
+    di->dst = 0;
+    di->imm = 0;
+    di->ALU_op = ERROR_OP;
+    generate_DXMW_control(op, &di->X_sigs, &di->M_sigs, &di->W_sigs);
+    extract_regs(insnbits, op, &di->src1, &di->src2, &di->dst);
+    decide_alu_op(op, &di->ALU_op);
+    if (op == OP_LDUR || op == OP_STUR)
+        di->imm = di->src2;
+    else
+        extract_immval(insnbits, op, &di->imm);
+}
+
+const decoded_insn_t *predecode(uint64_t PC, bool *imem_err) {
+    decoded_insn_t *di = dcache_entry(cur_guest->predecode, PC);
+    if (di->valid && di->PC == PC) {
+        *imem_err = false;
+        return di;
+    }
+
+    uint32_t insnbits = 0;
+    imem(PC, &insnbits, imem_err);
+    // Bad fetches are decoded but not cached, so they fault the same way every time.
+    if (*imem_err)
+        di = &cur_guest->predecode[PREDECODE_SIZE];
+
+    opcode_t op = itable[bitfield_u32(insnbits, 21, 11)];
+    fix_instr_aliases(insnbits, &op);
+    decode_fields(insnbits, op, di);
+    di->PC = PC;
+    di->valid = !*imem_err;
+    return di;
+}
+
+const decoded_insn_t *predecode_lookup(uint64_t PC, uint32_t insnbits, opcode_t op) {
+    decoded_insn_t *di = dcache_entry(cur_guest->predecode, PC);
+    if (di->valid && di->PC == PC && di->insnbits == insnbits && di->op == op)
+        return di;
+    return NULL;
+}
+
+void predecode_invalidate(machine_t *m, uint64_t addr, unsigned width) {
+    for (uint64_t PC = addr & ~0x3UL; PC < addr + width; PC += 4) {
+        decoded_insn_t *di = dcache_entry(m->predecode, PC);
+        if (di->valid && di->PC == PC)
+            di->valid = false;
+    }
+}
@@ -29,9 +29,10 @@
  * usage - Prints usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h]\n", argv[0]);
+    printf("Usage: %s [-hx]\n", argv[0]);
     printf("Options:\n");
     printf("  -h    Print this help message.\n");
+    printf("  -x    Check the simulator's extensions (replacement policies and -M) instead.\n");
 }
 
 /*
@@ -212,18 +213,166 @@ void test_csim()
     printf("\nTEST_CSIM_RESULTS=%d/40\n", total_points);
 }
 
+/* 
+ * runcsim - Runs the test simulator with the given options and collects
+ * its summary for the caller. Return 0 if any problems, 1 if OK.
+ */
+int runcsim(char *options, /* in */
+            int *hits, int *misses, int *dirty_evictions, int *clean_evictions) /* out */
+{
+    FILE *fp;
+    int status;
+    char cmd[MAX_STR];
+
+    sprintf(cmd, "./bin/csim %s > /dev/null", options);
+    status = system("rm -rf .csim_results");
+    if (status == -1) {
+        fprintf(stderr, "Error invoking system() for test sim: %s\n", strerror(errno));
+        return 0;
+    }
+    status = system(cmd);
+    if (status == -1) {
+        fprintf(stderr, "Error invoking system() for test sim: %s\n", strerror(errno));
+        return 0;
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Error running test simulator: Status %d\n", 
+                WEXITSTATUS(status));
+        return 0;
+    }
+    fp = fopen(".csim_results", "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Results for test simulator not found.\n");
+        return 0;
+    }
+    status = fscanf(fp, "%d %d %d %d", hits, misses, dirty_evictions, clean_evictions);
+    fclose(fp);
+    system("rm -rf .csim_results");
+    return status == 4;
+}
+
+/*
+ * test_policies - Check each replacement policy on two short traces
+ * through one 4-way set, against results worked out by hand. policy.trace
+ * evicts a line after a hit and then reads back the lines each policy may
+ * have chosen; scan.trace reuses one line before a run of new ones, which
+ * LRU lets evict it and RRIP does not. brrip and random follow the
+ * simulator's fixed random sequence. Returns the number of checks passed.
+ */
+
+#define NP 12  /* Number of policy tests */
+
+int test_policies()
+{
+    char *policy[NP] = {"lru", "plru", "nru", "srrip", "brrip", "random",
+                        "lru", "plru", "nru", "srrip", "brrip", "random"};
+    char *trace[NP] = {"policy.trace", "policy.trace", "policy.trace", "policy.trace", "policy.trace", "policy.trace",
+                       "scan.trace", "scan.trace", "scan.trace", "scan.trace", "scan.trace", "scan.trace"};
+    int hits[NP] = {2, 1, 3, 2, 3, 3, 1, 1, 1, 2, 2, 2};
+    int misses[NP] = {7, 8, 6, 7, 6, 6, 6, 6, 6, 5, 5, 5};
+    int clean_evictions[NP] = {3, 4, 2, 3, 2, 2, 2, 2, 2, 1, 1, 1};
+    int test_hits, test_misses, test_dirty_evictions, test_clean_evictions;
+    char options[MAX_STR];
+    int passed = 0;
+
+    printf("%8s%14s%8s%8s%8s|%8s%8s%8s\n", "Policy", "Trace",
+           "Hits", "Misses", "CEvicts", "Hits", "Misses", "CEvicts");
+    for (int i = 0; i < NP; i++) {
+        sprintf(options, "-A 4 -B 8 -C 32 -r %s -t testcases/cache/%s", policy[i], trace[i]);
+        if (!runcsim(options, &test_hits, &test_misses, &test_dirty_evictions, &test_clean_evictions))
+            test_hits = test_misses = test_dirty_evictions = test_clean_evictions = -1;
+        int pass = test_hits == hits[i] && test_misses == misses[i]
+            && test_dirty_evictions == 0 && test_clean_evictions == clean_evictions[i];
+        printf("%8s%14s%8d%8d%8d|%8d%8d%8d  %s\n", policy[i], trace[i],
+               test_hits, test_misses, test_clean_evictions,
+               hits[i], misses[i], clean_evictions[i], pass ? "ok" : "FAILED");
+        passed += pass;
+    }
+    return passed;
+}
+
+/*
+ * test_miss_curves - Check that every row of -M, fully associative and
+ * with 4 sets, has the hits and misses of a separate run of that cache
+ * on the same trace. Sets *total to the number of rows checked and returns
+ * the number that matched.
+ */
+int test_miss_curves(int *total)
+{
+    char *trace[] = {"yi2.trace", "yi.trace", "dave.trace", "trans.trace", "long.trace"};
+    char cmd[MAX_STR], line[MAX_STR], options[MAX_STR];
+    int passed = 0;
+
+    *total = 0;
+    for (int i = 0; i < sizeof(trace) / sizeof(trace[0]); i++) {
+        int rows = 0, matched = 0;
+        sprintf(cmd, "./bin/csim -M -B 16 -S 4 -t testcases/cache/%s", trace[i]);
+        FILE *fp = popen(cmd, "r");
+        if (!fp) {
+            fprintf(stderr, "Error running %s: %s\n", cmd, strerror(errno));
+            continue;
+        }
+        while (fgets(line, MAX_STR, fp)) {
+            int v[4], n = sscanf(line, "%d,%d,%d,%d", &v[0], &v[1], &v[2], &v[3]);
+            int A, C, hits, misses;
+            int test_hits, test_misses, test_dirty_evictions, test_clean_evictions;
+            if (n == 3) {
+                /* C,hits,misses of a fully associative cache */
+                C = v[0], A = C / 16, hits = v[1], misses = v[2];
+            } else if (n == 4) {
+                /* A,C,hits,misses of a cache with 4 sets */
+                A = v[0], C = v[1], hits = v[2], misses = v[3];
+            } else {
+                continue;
+            }
+            sprintf(options, "-A %d -B 16 -C %d -t testcases/cache/%s", A, C, trace[i]);
+            rows++;
+            if (runcsim(options, &test_hits, &test_misses, &test_dirty_evictions, &test_clean_evictions)
+                && test_hits == hits && test_misses == misses) {
+                matched++;
+            } else {
+                printf("(%d,16,%d) on %s: -M gave %d hits, %d misses; a separate run %d, %d\n",
+                       A, C, trace[i], hits, misses, test_hits, test_misses);
+            }
+        }
+        pclose(fp);
+        printf("%14s: %d of %d rows of -M match separate runs\n", trace[i], matched, rows);
+        passed += matched;
+        *total += rows;
+    }
+    return passed;
+}
+
+/*
+ * test_extensions - Run the checks of the simulator's extensions, which
+ * the reference simulator does not have.
+ */
+void test_extensions()
+{
+    int total;
+    int passed = test_policies();
+
+    printf("\n");
+    passed += test_miss_curves(&total);
+    printf("\nTEST_CSIM_EXTENSIONS=%d/%d\n", passed, NP + total);
+}
+
 /*
  * main - Main routine
  */
 int main(int argc, char* argv[]){
     char c;
+    int extensions = 0;
 
     /* Parse command line args */
-    while ((c = getopt(argc, argv, "h")) != -1) {
+    while ((c = getopt(argc, argv, "hx")) != -1) {
         switch(c) {
         case 'h':
             usage(argv);
             exit(0);
+        case 'x':
+            extensions = 1;
+            break;
         default:
             usage(argv);
             exit(1);
@@ -240,7 +389,10 @@ int main(int argc, char* argv[]){
     alarm(20);
 
     /* Evaluate the student's cache simulator for correctness */
-    test_csim();
+    if (extensions)
+        test_extensions();
+    else
+        test_csim();
 
     exit(0);
 }
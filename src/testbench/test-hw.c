@@ -34,19 +34,17 @@ int verbosity;
 bool extra_credit;
 char *op_to_test;
 
-machine_t       guest;
 opcode_t        itable[2<<11];
 FILE            *infile, *outfile, *errfile, *checkpoint;
 char            *infile_name;
 char            *hw_prompt;
-uint64_t        num_instr;
 uint64_t        cycle_max;
+uint64_t        ffwd_max;
+exec_mode_t     exec_mode;
 int             debug_level;
 int             A, B, C, d;
-uint64_t        inflight_cycles;
-uint64_t        inflight_addr;
-bool            inflight;
-mem_status_t    dmem_status;
+
+static machine_t machine;
 
 struct alu_test {
   uint64_t  vala;             // valA to pass in
@@ -231,10 +229,10 @@ static void print_regfile_test(struct regfile_testcase* test,
   );
 
   printf("\nRegister values (expected): \n");
-  print_regfile(test->GPR, guest.proc->GPR, true);
+  print_regfile(test->GPR, cur_guest->proc->GPR, true);
 
   printf("\nRegister values (got): \n");
-  print_regfile(guest.proc->GPR, test->GPR, false);
+  print_regfile(cur_guest->proc->GPR, test->GPR, false);
 }
 
 /* 
@@ -270,8 +268,8 @@ struct cond_holds_testcase new_cond_holds_testcase() {
 }
 
 void copy_regfile_state(struct regfile_testcase* testcase) {
-  memcpy(&testcase->GPR, &guest.proc->GPR, sizeof(gpreg_val_t) * 31);
-  memcpy(&testcase->SP, &guest.proc->SP, sizeof(uint64_t));
+  memcpy(&testcase->GPR, &cur_guest->proc->GPR, sizeof(gpreg_val_t) * 31);
+  memcpy(&testcase->SP, &cur_guest->proc->SP, sizeof(uint64_t));
 }
 
 struct alu_test new_alu_testcase() {
@@ -1185,7 +1183,7 @@ struct test_results run_regfile_tests(char* input_filename) {
       
       // check if registers match (no incorrect writes)
       for(int i = 0; i < 31; i++) {
-        if(testcase.GPR[i] != guest.proc->GPR[i]) {
+        if(testcase.GPR[i] != cur_guest->proc->GPR[i]) {
           gpr_failure = true;
         }
       }
@@ -1193,7 +1191,7 @@ struct test_results run_regfile_tests(char* input_filename) {
       if(gpr_failure) {
         gpr_fails++;
         fail = true;
-      } else if(testcase.SP != guest.proc->SP) {
+      } else if(testcase.SP != cur_guest->proc->SP) {
         sp_fails++;
         fail = true;
       }
@@ -1348,6 +1346,7 @@ int main(int argc, char* argv[]) {
   }
 
   init();
+  init_machine(&machine, -1, -1, -1, -1, false, REPL_LRU);
 
   struct test_results results = {0, 0, 0};
   double score = 0;
@@ -32,11 +32,12 @@
   * usage - Prints usage info
   */
  void usage(char *argv[]){
-     printf("Usage: %s [-hwv]\n", argv[0]);
+     printf("Usage: %s [-hwvx]\n", argv[0]);
      printf("Options:\n");
      printf("  -h        Print this help message.\n");
      printf("  -w <num>  Test a specific week. Defaults to week 2.\n");
      printf("  -v <num>  Verbosity level. Defaults to 0, which only shows final score.\n            Set to 1 to view which tests are failing.\n            Set to 2 to view all tests as they run.\n");
+     printf("  -x        Test the emulator's extensions (caches, memory timing, execution modes) instead.\n");
  #ifdef EC
      printf("  -e        Test extra credit test cases. Disabled by default.\n");
  #endif
@@ -209,13 +210,156 @@
      return this_score;
  }
  
+ /*
+  * Extension tests (-x). Each runs the emulator on mem/pipeminus/ldur_stur, which
+  * stores 31, 41, 59 and 26 to four consecutive words below the stack pointer and
+  * loads them back into X4-X7, with the options of one of its extensions, and
+  * looks for lines in its log and checkpoint. With -B 8 each word is a line of
+  * its own, so the cycles and counts follow from the program by hand: 21 cycles
+  * without stalls, and d - 1 more for each miss that stalls. Only the prefetch
+  * counts were taken from the emulator itself.
+  */
+ typedef struct ext_test {
+     char *options;
+     char *expect[4];    /* Lines the log or checkpoint must contain, up to a NULL */
+ } ext_test_t;
+ 
+ static ext_test_t ext_tests[] = {
+     /* One lookup per line: 4 misses, 4 hits, and 64 bytes less 2 per miss in the checkpoint */
+     {"-A 1 -B 8 -C 64 -d 10", {"after 57 cycles", "lookups that hit, missed: 4, 4", "cache hits, misses: 56, 4"}},
+     /* Tag-only: the same timing, with the stores left in memory */
+     {"-A 1 -B 8 -C 64 -d 10 -T", {"after 57 cycles", "cache hits, misses: 56, 4", "Address 0x7ffffffd8: 0x1f"}},
+     /* Functional execution and fast-forwarding */
+     {"-x func", {"Executed 14 instructions functionally", "Address 0x7fffffff0: 0x1a"}},
+     {"-x dbt", {"Executed 14 instructions functionally", "Address 0x7fffffff0: 0x1a"}},
+     {"-f 5", {"Fast-forwarded 5 instructions", "after 16 cycles"}},
+     /* A sweep reports the cycles and line lookups a run of each configuration would have */
+     {"-s 1:8:64:10,1:8:16:10,4:8:32:100", {"1,8,64,10,57,4,4", "1,8,16,10,93,0,8", "4,8,32,100,417,4,4"}},
+     /* MSHRs: the stores all miss at once and the first load waits on its line */
+     {"-A 1 -B 8 -C 64 -d 100 -m 4", {"MSHR merges, stalls with every MSHR busy: 1, 0", "lookups that hit, missed: 3, 5"}},
+     /* With B = 32 the last three stores merge into the second line's MSHR */
+     {"-A 1 -B 32 -C 64 -d 100 -m 4", {"MSHR merges, stalls with every MSHR busy: 3, 0", "lookups that hit, missed: 3, 5"}},
+     {"-A 1 -B 8 -C 64 -d 100 -m 1", {"MSHR merges, stalls with every MSHR busy: 1, 3", "lookups that hit, missed: 3, 5"}},
+     /* Write buffer: every load is served from the stores still waiting there */
+     {"-A 1 -B 8 -C 64 -d 100 -w 4", {"after 21 cycles", "stores, writebacks, forwards, stalls when full: 4, 0, 4, 0"}},
+     {"-A 1 -B 8 -C 64 -d 100 -w 1", {"after 219 cycles", "stores, writebacks, forwards, stalls when full: 2, 0, 0, 2"}},
+     /* DRAM: one row for all four lines, a row per line, and closed rows */
+     {"-A 1 -B 8 -C 64 -d 10 -D 1:1:1024:10:10:10", {"after 67 cycles", "row hits, empty rows, conflicts: 3, 1, 0; mean latency 12.5"}},
+     {"-A 1 -B 8 -C 64 -d 10 -D 1:1:8:10:10:10", {"after 127 cycles", "row hits, empty rows, conflicts: 0, 1, 3; mean latency 27.5"}},
+     {"-A 1 -B 8 -C 64 -d 10 -D 1:1:1024:10:10:10:closed", {"row hits, empty rows, conflicts: 0, 4, 0"}},
+     /* Prefetching: late prefetches, and polluting ones with a degree of 2 */
+     {"-A 1 -B 8 -C 64 -d 10 -p next-line", {"issued, useful, late, polluting, dropped: 4, 2, 1, 0, 0"}},
+     {"-A 1 -B 8 -C 16 -d 2 -p next-line -P 2", {"issued, useful, late, polluting, dropped: 12, 6, 0, 2, 0"}},
+     /* An instruction cache fetches each of the program's 8 lines once */
+     {"-A 1 -B 8 -C 64 -d 10 -I 1:8:16", {"L1I cache hits, misses: 0, 8"}},
+     /* A one-line L2: inclusion evicts every line from the L1 as the next one arrives */
+     {"-A 4 -B 8 -C 32 -d 10 -L 1:8:8:10 -H non-inclusive", {"lookups that hit, missed: 4, 4", "L2 cache hits, misses: 0, 4"}},
+     {"-A 4 -B 8 -C 32 -d 10 -L 1:8:8:10 -H inclusive", {"lookups that hit, missed: 0, 8", "L2 cache hits, misses: 0, 8"}},
+     /* Two-line L1 and L2: only an exclusive L2 keeps the L1's victims for the loads */
+     {"-A 1 -B 8 -C 16 -d 10 -L 1:8:16:10 -H non-inclusive", {"L2 cache hits, misses: 0, 8"}},
+     {"-A 1 -B 8 -C 16 -d 10 -L 1:8:16:10 -H exclusive", {"after 133 cycles", "L2 cache hits, misses: 4, 4"}},
+ };
+ 
+ /* The loads' results, which every option must leave unchanged */
+ static char *ext_loaded[] = {"X4: 1f", "X5: 29", "X6: 3b", "X7: 1a"};
+ 
+ /*
+  * read_file - Appends the contents of path to buf, which holds len bytes of
+  * size. Returns the new buffer, or NULL if the file can't be read.
+  */
+ static char *read_file(char *path, char *buf, size_t *len, size_t *size) {
+     FILE *fp = fopen(path, "r");
+     size_t n;
+ 
+     if (!fp) {
+         return NULL;
+     }
+     do {
+         if (*size - *len < MAX_STR) {
+             *size = 2 * *size + MAX_STR;
+             buf = realloc(buf, *size);
+         }
+         n = fread(buf + *len, 1, MAX_STR - 1, fp);
+         *len += n;
+     } while (n > 0);
+     buf[*len] = 0;
+     fclose(fp);
+     return buf;
+ }
+ 
+ /*
+  * run_ext_test - Runs the emulator with one extension test's options and
+  * checks its log and checkpoint. Return 0 if any problems, 1 if OK.
+  */
+ static int run_ext_test(ext_test_t *test) {
+     char cmd[MAX_STR];
+     char *output = "checkpoints/output_ext.out";
+     char *checkpoint = "checkpoints/checkpoint_ext.out";
+     char *text = NULL;
+     size_t len = 0, size = 0;
+     int pass = 1;
+ 
+     sprintf(cmd, "./bin/se %s -l 100000 -i testcases/mem/pipeminus/ldur_stur -c %s > %s 2>&1", 
+             test->options, checkpoint, output);
+     int status = system(cmd);
+     if (status == -1 || (WIFEXITED(status) && WEXITSTATUS(status) != 0)) {
+         if (verbosity > 0) {
+             fprintf(stderr, "Error running student emulator with %s\n", test->options);
+         }
+         pass = 0;
+     }
+     if (pass && (!(text = read_file(output, text, &len, &size)) 
+                  || !(text = read_file(checkpoint, text, &len, &size)))) {
+         fprintf(stderr, "Error reading %s and %s: %s\n", output, checkpoint, strerror(errno));
+         pass = 0;
+     }
+     for (int i = 0; pass && i < 4 + 4; i++) {
+         char *line = i < 4 ? ext_loaded[i] : test->expect[i - 4];
+         if (!line) {
+             break;
+         }
+         if (!strstr(text, line)) {
+             if (verbosity > 0) {
+                 fprintf(stderr, "Failed extension test %s: no \"%s\"\n", test->options, line);
+             }
+             pass = 0;
+         }
+     }
+     free(text);
+ 
+     /* Cleanup */
+     sprintf(cmd, "rm -f %s %s", output, checkpoint);
+     if (system(cmd) == -1) {
+         fprintf(stderr, "Error removing files %s and %s: %s\n", 
+                 output, checkpoint, strerror(errno));
+         return 0;
+     }
+     return pass;
+ }
+ 
+ /*
+  * run_ext_tests - Runs every extension test. Returns the number passed.
+  */
+ static int run_ext_tests(void) {
+     int total = 0;
+ 
+     for (size_t i = 0; i < sizeof(ext_tests) / sizeof(ext_tests[0]); i++) {
+         if (verbosity > 1) {
+             fprintf(stderr, "Running mem/pipeminus/ldur_stur with %s\n", ext_tests[i].options);
+         }
+         total += run_ext_test(&ext_tests[i]);
+     }
+     return total;
+ }
+ 
  int main(int argc, char* argv[]) {
      char c;
      int week = 2;
      verbosity = 0;
      int ec = 0;
+     int ext = 0;
      /* Parse command line args. */
-     while ((c = getopt(argc, argv, ":h:w:v:e")) != -1) {
+     while ((c = getopt(argc, argv, ":h:w:v:ex")) != -1) {
          switch(c) {
          case 'h':
              usage(argv);
@@ -226,6 +370,9 @@
          case 'v':
              verbosity = atoi(optarg);
              break;
+         case 'x':
+             ext = 1;
+             break;
  #ifdef EC
          case 'e':
              ec = 1;
@@ -261,6 +408,13 @@
      /* Time out and give up after a while in case of infinite loops */
      alarm(200);
  
+     if (ext) {
+         size_t num_ext_tests = sizeof(ext_tests) / sizeof(ext_tests[0]);
+         int passed_ext = run_ext_tests();
+         printf("Total extension tests passed: %d of %ld.\n", passed_ext, num_ext_tests);
+         exit(passed_ext == num_ext_tests ? EXIT_SUCCESS : EXIT_FAILURE);
+     }
+ 
      double score = 0.0;
  
      /* If you add a new directory for testcases then you gotta: